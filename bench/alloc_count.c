@@ -0,0 +1,45 @@
+/**
+ * @file alloc_count.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief Preloaded library that counts the allocations of a process. The count
+ * is written at exit into the file named by ALLOC_COUNT_FILE.
+ * @copyright Copyright (c) 2021
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long allocations = 0;
+
+void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+__attribute__((destructor)) static void report(void) {
+    const char *path = getenv("ALLOC_COUNT_FILE");
+    FILE *file;
+
+    if (path == NULL) { return; }
+
+    file = fopen(path, "w");
+    if (file != NULL) {
+        fprintf(file, "%lu\n", allocations);
+        fclose(file);
+    }
+}
@@ -0,0 +1,206 @@
+/**
+ * @file generate.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief Generates the synthetic workloads used by the benchmarks
+ * @copyright Copyright (c) 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INCLUDE_DIRS 64 /* The number of -I directories of "includes" */
+#define CHAIN_DEPTH 500
+#define NESTING_DEPTH 200
+
+/**
+ * @brief Open a file for writing (the generator stops if it can't)
+ * @param dir The directory
+ * @param name The name of the file
+ * @return FILE* The file
+ */
+FILE *open_file(const char *dir, const char *name) {
+    char path[1024];
+    FILE *file;
+
+    sprintf(path, "%.500s/%.500s", dir, name);
+    file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    return file;
+}
+
+/**
+ * @brief A big file, with common code and a few macros
+ */
+void gen_huge(FILE *out, FILE *args, long scale) {
+    long i;
+
+    fprintf(out, "#define FOO 42\n#define BAR FOO + 1\n#define TYPE int\n");
+    for (i = 0; i < 200000 * scale; ++i) {
+        fprintf(out, "TYPE var_%ld = FOO * %ld + BAR ;\n", i, i % 97);
+        if (i % 10 == 0) { fprintf(out, "\n"); }
+    }
+    (void)args;
+}
+
+/**
+ * @brief Few lines, each of them very long
+ */
+void gen_long_lines(FILE *out, FILE *args, long scale) {
+    long i, j;
+
+    fprintf(out, "#define ITEM 1\n");
+    for (i = 0; i < 64 * scale; ++i) {
+        for (j = 0; j < 8192; ++j) { fprintf(out, "ITEM + x%ld ", j); }
+        fprintf(out, ";\n");
+    }
+    (void)args;
+}
+
+/**
+ * @brief Thousands of defines, each of them used
+ */
+void gen_defines(FILE *out, FILE *args, long scale) {
+    long i;
+
+    for (i = 0; i < 20000 * scale; ++i) {
+        fprintf(out, "#define MACRO_%ld %ld\n", i, i);
+    }
+    for (i = 0; i < 20000 * scale; ++i) {
+        fprintf(out, "int v%ld = MACRO_%ld + MACRO_%ld ;\n", i, i,
+                (i * 7919) % (20000 * scale));
+    }
+    (void)args;
+}
+
+/**
+ * @brief Macros defined using other macros, many levels deep
+ */
+void gen_chains(FILE *out, FILE *args, long scale) {
+    long i;
+
+    fprintf(out, "#define CHAIN_0 1\n");
+    for (i = 1; i < CHAIN_DEPTH; ++i) {
+        fprintf(out, "#define CHAIN_%ld CHAIN_%ld + %ld\n", i, i - 1, i);
+    }
+    for (i = 0; i < 20000 * scale; ++i) {
+        fprintf(out, "int c%ld = CHAIN_%ld ;\n", i,
+                CHAIN_DEPTH - 1 - i % 10);
+    }
+    (void)args;
+}
+
+/**
+ * @brief Deeply nested conditionals
+ */
+void gen_nesting(FILE *out, FILE *args, long scale) {
+    long i, j;
+
+    fprintf(out, "#define ON 1\n");
+    for (i = 0; i < 500 * scale; ++i) {
+        for (j = 0; j < NESTING_DEPTH; ++j) {
+            fprintf(out, "#ifdef ON\nint n%ld_%ld ;\n", i, j);
+        }
+        for (j = 0; j < NESTING_DEPTH; ++j) { fprintf(out, "#endif\n"); }
+    }
+    (void)args;
+}
+
+/**
+ * @brief Many include directories, the headers being in the last one
+ */
+void gen_includes(FILE *out, FILE *args, const char *dir, long scale) {
+    char path[1024];
+    FILE *header;
+    long i;
+
+    for (i = 0; i < INCLUDE_DIRS; ++i) {
+        sprintf(path, "mkdir -p %.500s/inc/d%ld", dir, i);
+        if (system(path) != 0) { exit(1); }
+        fprintf(args, "-I%s/inc/d%ld\n", dir, i);
+    }
+
+    for (i = 0; i < 200; ++i) {
+        sprintf(path, "%.500s/inc/d%d", dir, INCLUDE_DIRS - 1);
+        sprintf(path + strlen(path), "/h%ld.h", i);
+        header = fopen(path, "w");
+        if (header == NULL) {
+            perror(path);
+            exit(1);
+        }
+        fprintf(header, "#ifndef H%ld_H\n#define H%ld_H\n", i, i);
+        fprintf(header, "#define H%ld_VALUE %ld\nint h%ld ;\n#endif\n", i, i,
+                i);
+        fclose(header);
+    }
+
+    for (i = 0; i < 20000 * scale; ++i) {
+        fprintf(out, "#include \"h%ld.h\"\nint u%ld = H%ld_VALUE ;\n", i % 200,
+                i, i % 200);
+    }
+}
+
+/**
+ * @brief Mostly inactive conditional regions
+ */
+void gen_dead(FILE *out, FILE *args, long scale) {
+    long i, j;
+
+    for (i = 0; i < 2000 * scale; ++i) {
+        fprintf(out, "#ifdef NOT_DEFINED\n");
+        for (j = 0; j < 100; ++j) {
+            fprintf(out, "int dead_%ld_%ld = SOMETHING + %ld ;\n", i, j, j);
+        }
+        fprintf(out, "#else\nint alive_%ld ;\n#endif\n", i);
+    }
+    (void)args;
+}
+
+int main(int argc, char *argv[]) {
+    char name[256];
+    FILE *out, *args;
+    long scale;
+
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s <workload> <scale> <directory>\n",
+                argv[0]);
+        fprintf(stderr, "Workloads: huge long_lines defines chains nesting "
+                        "includes dead\n");
+        return 1;
+    }
+
+    scale = atol(argv[2]);
+    if (scale < 1) { scale = 1; }
+
+    /* The input, and the extra arguments it needs (one on every line) */
+    sprintf(name, "%.200s.c", argv[1]);
+    out = open_file(argv[3], name);
+    sprintf(name, "%.200s.args", argv[1]);
+    args = open_file(argv[3], name);
+
+    if (strcmp(argv[1], "huge") == 0) {
+        gen_huge(out, args, scale);
+    } else if (strcmp(argv[1], "long_lines") == 0) {
+        gen_long_lines(out, args, scale);
+    } else if (strcmp(argv[1], "defines") == 0) {
+        gen_defines(out, args, scale);
+    } else if (strcmp(argv[1], "chains") == 0) {
+        gen_chains(out, args, scale);
+    } else if (strcmp(argv[1], "nesting") == 0) {
+        gen_nesting(out, args, scale);
+    } else if (strcmp(argv[1], "includes") == 0) {
+        gen_includes(out, args, argv[3], scale);
+    } else if (strcmp(argv[1], "dead") == 0) {
+        gen_dead(out, args, scale);
+    } else {
+        fprintf(stderr, "Unknown workload: %s\n", argv[1]);
+        return 1;
+    }
+
+    fclose(out);
+    fclose(args);
+    return 0;
+}
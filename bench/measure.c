@@ -0,0 +1,54 @@
+/**
+ * @file measure.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief Runs a command, and reports its wall time and peak memory usage
+ * @copyright Copyright (c) 2021
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    struct timespec start, end;
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <command> [arguments]\n", argv[0]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        execvp(argv[1], argv + 1);
+        perror(argv[1]);
+        _exit(127);
+    }
+
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_CHILDREN, &usage);
+
+    /* seconds peak_rss_kb exit_code */
+    printf("%.6f %ld %d\n",
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+           usage.ru_maxrss, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    return 0;
+}
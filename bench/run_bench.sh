@@ -0,0 +1,105 @@
+#!/bin/bash
+
+#
+# Runs the preprocessor over the generated workloads, and reports, for each of
+# them, the throughput (MB/s, lines/s), the peak RSS and the allocations done
+# for every input line. The results are saved as a JSON baseline.
+#
+# Environment:
+#   SCALE     - the size multiplier of the workloads (default 1)
+#   RUNS      - the number of timed runs, the best one is kept (default 3)
+#   NAME      - the name of the saved baseline (default "latest")
+#   BASELINE  - a previously saved baseline, to compare against
+#   WORKLOADS - the workloads to run (default all)
+#
+
+# The baseline path is relative to the caller's directory
+if [ -n "$BASELINE" ]; then
+    BASELINE="$(cd "$(dirname "$BASELINE")" && pwd)/$(basename "$BASELINE")"
+fi
+
+cd "$(dirname "$0")" || exit 1
+
+exe=../so-cpp
+work=_work
+results=results
+scale=${SCALE:-1}
+runs=${RUNS:-3}
+name=${NAME:-latest}
+workloads=${WORKLOADS:-"huge long_lines defines chains nesting includes dead"}
+
+mkdir -p "$work" "$results"
+out="$results/$name.json"
+
+printf "%-12s %8s %8s %10s %10s %10s %8s %12s\n" workload size_mb lines \
+    time_s MB/s lines/s rss_kb allocs/line
+echo "{" > "$out"
+echo "  \"scale\": $scale," >> "$out"
+echo "  \"workloads\": {" >> "$out"
+
+first=1
+for w in $workloads; do
+    # Generate the workload only once for every scale
+    if [ ! -f "$work/$w.c" ] || [ "$(cat "$work/$w.scale" 2>/dev/null)" != "$scale" ]; then
+        if [ "$w" = includes ]; then rm -rf "$work/inc"; fi
+        ./generate "$w" "$scale" "$work" || exit 1
+        echo "$scale" > "$work/$w.scale"
+    fi
+
+    mapfile -t args < "$work/$w.args"
+    bytes=$(wc -c < "$work/$w.c")
+    lines=$(wc -l < "$work/$w.c")
+
+    best=""
+    rss=0
+    for _ in $(seq "$runs"); do
+        read -r time peak code < <(./measure "$exe" "${args[@]}" \
+            "$work/$w.c" -o /dev/null)
+        if [ "$code" != "0" ]; then
+            echo "$w: the preprocessor failed (exit code $code)" >&2
+            exit 1
+        fi
+        if [ -z "$best" ] || awk "BEGIN { exit !($time < $best) }"; then
+            best=$time
+        fi
+        if [ "$peak" -gt "$rss" ]; then rss=$peak; fi
+    done
+
+    ALLOC_COUNT_FILE="$work/allocs" LD_PRELOAD="$PWD/alloc_count.so" \
+        "$exe" "${args[@]}" "$work/$w.c" -o /dev/null
+    allocs=$(cat "$work/allocs")
+
+    read -r size mbs lps apl < <(awk -v b="$bytes" -v l="$lines" -v t="$best" \
+        -v a="$allocs" 'BEGIN {
+            if (t <= 0) t = 1e-6;
+            printf "%.2f %.2f %.0f %.3f\n", b / 1048576, b / 1048576 / t,
+                   l / t, a / l
+        }')
+
+    printf "%-12s %8s %8s %10s %10s %10s %8s %12s\n" "$w" "$size" "$lines" \
+        "$best" "$mbs" "$lps" "$rss" "$apl"
+
+    if [ $first -eq 0 ]; then echo "," >> "$out"; fi
+    first=0
+    printf '    "%s": {"bytes": %s, "lines": %s, "seconds": %s, "mb_per_s": %s, "lines_per_s": %s, "peak_rss_kb": %s, "allocations": %s, "allocs_per_line": %s}' \
+        "$w" "$bytes" "$lines" "$best" "$mbs" "$lps" "$rss" "$allocs" \
+        "$apl" >> "$out"
+done
+
+printf "\n  }\n}\n" >> "$out"
+echo "Saved the results in bench/$out"
+
+# Compare the throughput with the one of a saved baseline
+if [ -n "$BASELINE" ]; then
+    python3 - "$BASELINE" "$out" <<'PY'
+import json, sys
+old = json.load(open(sys.argv[1]))["workloads"]
+new = json.load(open(sys.argv[2]))["workloads"]
+print("%-12s %12s %12s %8s" % ("workload", "old MB/s", "new MB/s", "change"))
+for w, n in new.items():
+    if w in old:
+        o = old[w]["mb_per_s"]
+        change = (n["mb_per_s"] - o) / o * 100 if o else 0
+        print("%-12s %12.2f %12.2f %+7.1f%%" % (w, o, n["mb_per_s"], change))
+PY
+fi
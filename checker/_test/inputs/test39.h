@@ -0,0 +1,12 @@
+
+#ifndef TEST39_H
+#define TEST39_H
+
+#if 1
+int var;
+#else
+int other;
+#endif
+
+#endif /* TEST39_H */
+
@@ -0,0 +1,4 @@
+#pragma once
+#define ONCE 40
+
+int once;
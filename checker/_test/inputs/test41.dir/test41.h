@@ -0,0 +1,4 @@
+# ifndef TEST41_DIR_H
+#define TEST41_DIR_H
+int space;
+#endif
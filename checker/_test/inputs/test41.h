@@ -0,0 +1,4 @@
+	#ifndef TEST41_H
+#define TEST41_H
+int tab;
+#endif
@@ -0,0 +1 @@
+#define HDR 2
@@ -0,0 +1,2 @@
+#define VERSION 2
+#define EXTRA 3
@@ -0,0 +1 @@
+#include "test51.dir/test51.h"
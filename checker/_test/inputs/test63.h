@@ -0,0 +1,4 @@
+	#pragma once
+#define TABBED 63
+
+int tabbed;
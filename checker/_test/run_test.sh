@@ -12,7 +12,7 @@ REF_DIR=_test/ref
 OUT_DIR=_test/outputs
 EXEC_NAME=./so-cpp
 
-max_points=95
+max_points=134
 
 TEST_LIB=_test/test_lib.sh
 
@@ -121,6 +121,30 @@ test_cpp_stdout()
 	cleanup_test
 }
 
+test_ref()
+{
+	init_test
+	$MEMCHECK $EXEC_NAME $params $input_f > $out_f
+	mem_res=$?
+	basic_test compare $out_f $INPUT_DIR"/test"$test_index".ref"
+	memory_test $mem_res
+	cleanup_test
+}
+
+test_deps()
+{
+	init_test
+	dep_f=$OUT_DIR"/test"$test_index".d"
+	$MEMCHECK $EXEC_NAME $params $input_f > $out_f
+	mem_res=$?
+	# The rule is written in its own file (set by the params), after the output
+	cat $dep_f >> $out_f
+	basic_test compare $out_f $INPUT_DIR"/test"$test_index".ref"
+	memory_test $mem_res
+	rm -f $dep_f
+	cleanup_test
+}
+
 test_bad_params()
 {
 	init_test
@@ -129,6 +153,142 @@ test_bad_params()
 	cleanup_test
 }
 
+start_server()
+{
+	sock_f=$OUT_DIR"/test"$test_index".sock"
+	$EXEC_NAME -S $sock_f &
+	server_pid=$!
+
+	# Wait for the server to listen
+	for ((i = 0; i < 50; i++)); do
+		test -S $sock_f && break
+		sleep 0.1
+	done
+}
+
+stop_server()
+{
+	kill $server_pid
+	wait $server_pid 2> /dev/null
+	rm -f $sock_f
+}
+
+test_server()
+{
+	init_test
+	$CPP $params $input_f > $ref_f
+	cat $ref_f $ref_f > $ref_f".twice"
+	start_server
+	# The second request reuses the state of the first one
+	$EXEC_NAME -C $sock_f $params $input_f > $out_f
+	$EXEC_NAME -C $sock_f $params $input_f >> $out_f
+	stop_server
+	basic_test compare $out_f $ref_f".twice"
+	rm -f $ref_f".twice"
+	cleanup_test
+}
+
+test_server_bad()
+{
+	init_test
+	start_server
+	$EXEC_NAME -C $sock_f $params < /dev/null > /dev/null 2>&1
+	res=$?
+	stop_server
+	basic_test test $res -ne 0
+	cleanup_test
+}
+
+check_client_batch()
+{
+	# Both inputs are written in the directory, and none is overwritten
+	compare $batch_dir"/test"$test_index".in" $ref_f &&
+		compare $batch_dir"/test"$test_index".c" $other_f &&
+		compare $other_f $INPUT_DIR"/test"$test_index".c"
+}
+
+test_client_batch()
+{
+	init_test
+	batch_dir=$OUT_DIR"/test"$test_index".batch"
+	other_f=$OUT_DIR"/test"$test_index".c"
+	mkdir -p $batch_dir
+	cp $INPUT_DIR"/test"$test_index".c" $other_f
+	$CPP $params $input_f > $ref_f
+	# There is no server, so the batch runs in the client
+	$EXEC_NAME -C $OUT_DIR"/none.sock" -B $batch_dir $params $input_f \
+		$other_f > /dev/null
+	basic_test check_client_batch
+	rm -rf $batch_dir $other_f
+	cleanup_test
+}
+
+check_batch()
+{
+	# Every output matches, and no error was reported
+	test $batch_res -eq 0 || return 1
+	for ((i = 0; i < 16; i++)); do
+		compare $batch_dir"/out/in"$i".c" $batch_dir"/in"$i".ref" || return 1
+	done
+}
+
+test_batch()
+{
+	init_test
+	batch_dir=$OUT_DIR"/test"$test_index".batch"
+	mkdir -p $batch_dir/out
+	# Many inputs full of definitions, so the workers define at the same time
+	for ((i = 0; i < 16; i++)); do
+		awk -v n=$i '{ t[NR] = $0 } END {
+			for (r = 0; r < 500; r++)
+				for (l = 1; l <= NR; l++) {
+					s = t[l]; gsub("@", n "_" r, s); print s
+				}
+		}' $input_f > $batch_dir"/in"$i".c"
+		$CPP $params $batch_dir"/in"$i".c" > $batch_dir"/in"$i".ref"
+	done
+	$EXEC_NAME -B $batch_dir/out -j 8 $params $batch_dir/in*.c > /dev/null
+	batch_res=$?
+	basic_test check_batch
+	rm -rf $batch_dir
+	cleanup_test
+}
+
+test_snapshot()
+{
+	init_test
+	snap_f=$OUT_DIR"/test"$test_index".snap"
+	prelude_f=$INPUT_DIR"/test"$test_index".h"
+	cat $prelude_f $input_f | $CPP $params > $ref_f
+	$EXEC_NAME $params -W $snap_f $prelude_f > /dev/null
+	$MEMCHECK $EXEC_NAME $params -P $snap_f $input_f > $out_f
+	mem_res=$?
+	basic_test compare $out_f $ref_f
+	memory_test $mem_res
+	rm -f $snap_f
+	cleanup_test
+}
+
+test_server_snapshot()
+{
+	init_test
+	snap_f=$OUT_DIR"/test"$test_index".snap"
+	prelude_f=$INPUT_DIR"/test"$test_index".h"
+	other_f=$INPUT_DIR"/test"$test_index".dir/test"$test_index".h"
+	cat $prelude_f $input_f | $CPP $params > $ref_f
+	cat $other_f $input_f | $CPP $params >> $ref_f
+	start_server
+	$EXEC_NAME $params -W $snap_f $prelude_f > /dev/null
+	$EXEC_NAME -C $sock_f $params -P $snap_f $input_f > $out_f
+	# The snapshot is replaced while the server has it loaded
+	$EXEC_NAME $params -W $snap_f $other_f > /dev/null
+	$EXEC_NAME -C $sock_f $params -P $snap_f $input_f >> $out_f
+	stop_server
+	basic_test compare $out_f $ref_f
+	rm -f $snap_f
+	cleanup_test
+}
+
 run_until_success()
 {
 	REF_CODE=12 # ENOMEM
@@ -239,6 +399,31 @@ test_fun_array=(                                                         \
 	test_cpp                "Test include order no main"        1   1    \
 	test_cpp                "Test include guard"                2   1    \
 	test_so_alloc           "Test everything"                   10  0    \
+	test_cpp                "Test include guard twice"          1   1    \
+	test_cpp                "Test pragma once"                  1   1    \
+	test_ref                "Test include not guarded"          1   1    \
+	test_server             "Test server requests"              1   0    \
+	test_server_bad         "Test server bad request"           1   0    \
+	test_client_batch       "Test client batch no server"       1   0    \
+	test_snapshot           "Test snapshot"                     1   1    \
+	test_server_snapshot    "Test server snapshot update"       1   0    \
+	test_bad_params         "Test bad snapshot"                 1   0    \
+	test_cpp                "Test if expressions"               1   1    \
+	test_cpp                "Test if overflow"                  1   1    \
+	test_bad_params         "Test if division by zero"          1   0    \
+	test_ref                "Test dependencies"                 1   1    \
+	test_deps               "Test dependencies file"            1   1    \
+	test_deps               "Test dependencies only file"       1   1    \
+	test_bad_params         "Test dependencies missing file"    1   0    \
+	test_bad_params         "Test dependencies bad option"      1   0    \
+	test_cpp                "Test macros at line end"           1   1    \
+	test_bad_params         "Test define without name"          1   0    \
+	test_cpp                "Test inactive regions"             1   1    \
+	test_cpp                "Test lazy conditions"              1   1    \
+	test_cpp                "Test long expansion"               1   1    \
+	test_batch              "Test batch definitions"            1   0    \
+	test_bad_params         "Test batch bad workers"            1   0    \
+	test_cpp                "Test pragma once indented"         1   1    \
 )
 
 # ---------------------------------------------------------------------------- #
@@ -6,7 +6,7 @@
 # 2020, Operating Systems
 #
 first_test=0
-last_test=38
+last_test=63
 script=./_test/run_test.sh
 
 # Call init to set up testing environment
@@ -29,7 +29,7 @@ BEGIN {
 }
 
 END {
-    printf "\n%66s  [%02d/95]\n", "Total:", sum;
+    printf "\n%66s  [%02d/134]\n", "Total:", sum;
 }'
 
 # Cleanup testing environment
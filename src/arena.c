@@ -0,0 +1,114 @@
+/**
+ * @file arena.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the arena allocator
+ * @copyright Copyright (c) 2021
+ */
+
+#include "arena.h"
+
+/* Round a size up, to a multiple of the alignment */
+#define ALIGN_UP(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/* The size of a block header (aligned) */
+#define HEADER_SIZE ALIGN_UP(sizeof(ArenaBlock))
+
+/* The start of the data of a block */
+#define BLOCK_DATA(block) ((char *)(block) + HEADER_SIZE)
+
+void *arena_alloc(Arena *const this, size_t size) {
+    ArenaBlock *block = this->_blocks;
+    void *ptr;
+
+    size = ALIGN_UP(size == 0 ? 1 : size);
+
+    if (block == NULL || block->capacity - block->used < size) {
+        /* A new block is needed. Bigger allocations get their own block */
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+        block = malloc(HEADER_SIZE + capacity);
+        if (block == NULL) {
+            CERR(TRUE, "Couldn't allocate a new arena block");
+            return NULL;
+        }
+
+        block->capacity = capacity;
+        block->used = 0;
+        block->next = this->_blocks;
+        this->_blocks = block;
+    }
+
+    ptr = BLOCK_DATA(block) + block->used;
+    block->used += size;
+    memset(ptr, 0, size);
+
+    this->_last = ptr;
+    return ptr;
+}
+
+void *arena_grow(Arena *const this, void *ptr, size_t old_size,
+                 size_t new_size) {
+    ArenaBlock *block = this->_blocks;
+    void *new_ptr;
+
+    if (ptr != NULL && ptr == this->_last) {
+        size_t offset = (char *)ptr - BLOCK_DATA(block);
+
+        if (block->capacity - offset >= ALIGN_UP(new_size)) {
+            /* Extend the last allocation */
+            if (new_size > old_size) {
+                memset((char *)ptr + old_size, 0, new_size - old_size);
+            }
+            if (offset + ALIGN_UP(new_size) > block->used) {
+                block->used = offset + ALIGN_UP(new_size);
+            }
+            return ptr;
+        }
+    }
+
+    new_ptr = this->alloc(this, new_size);
+    if (new_ptr != NULL && ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return new_ptr;
+}
+
+int arena_reset(Arena *const this) {
+    ArenaBlock *curr = this->_blocks;
+    ArenaBlock *kept = NULL;
+
+    /* Keep a normal block, free the others */
+    while (curr != NULL) {
+        ArenaBlock *next = curr->next;
+
+        if (kept == NULL && curr->capacity == ARENA_BLOCK_SIZE) {
+            kept = curr;
+        } else {
+            free(curr);
+        }
+        curr = next;
+    }
+
+    if (kept != NULL) {
+        kept->used = 0;
+        kept->next = NULL;
+    }
+
+    this->_blocks = kept;
+    this->_last = NULL;
+    return 0;
+}
+
+int arena_clear(Arena *const this) {
+    ArenaBlock *curr = this->_blocks;
+
+    while (curr != NULL) {
+        ArenaBlock *next = curr->next;
+        free(curr);
+        curr = next;
+    }
+
+    this->_blocks = NULL;
+    this->_last = NULL;
+    return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file arena.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the arena allocator
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error_handling.h"
+
+#define ARENA_BLOCK_SIZE 65536 /* The size of a (normal) block */
+#define ARENA_ALIGN 16         /* The alignment of the allocations */
+
+/* A "constructor" for the arena */
+#define INIT_ARENA                                               \
+    {                                                            \
+        0, 0, arena_alloc, arena_grow, arena_reset, arena_clear \
+    }
+
+/**
+ * @brief A block of memory of the arena. The data follows the header.
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t capacity;
+    size_t used;
+} ArenaBlock;
+
+/**
+ * @brief An arena (bump) allocator. The allocations are taken from large
+ * blocks, and they are never freed one by one. Instead, the whole arena is
+ * reset, when the allocated data is not needed anymore.
+ */
+typedef struct Arena {
+    ArenaBlock *_blocks; /* The current block is the first one */
+    void *_last;         /* The last allocation (it can be grown in place) */
+
+    void *(*alloc)(struct Arena *const this, size_t size);
+    void *(*grow)(struct Arena *const this, void *ptr, size_t old_size,
+                  size_t new_size);
+    int (*reset)(struct Arena *const this);
+    int (*clear)(struct Arena *const this);
+} Arena;
+
+/**
+ * @brief Allocate zero-initialised memory from the arena
+ * @param this The arena this function is attached to
+ * @param size The size of the allocation
+ * @return void* The allocated memory (NULL if the allocation failed)
+ */
+void *arena_alloc(Arena *const this, size_t size);
+
+/**
+ * @brief Increase the size of an allocation. If it was the last allocation
+ * and the block has enough space, it is extended in place. Otherwise, the data
+ * is copied into a new allocation.
+ * @param this The arena this function is attached to
+ * @param ptr The allocation
+ * @param old_size The size of the data in the allocation
+ * @param new_size The required size
+ * @return void* The allocation (NULL if the allocation failed)
+ */
+void *arena_grow(Arena *const this, void *ptr, size_t old_size,
+                 size_t new_size);
+
+/**
+ * @brief Release all the allocations at once. A block is kept for the next
+ * allocations, the others are freed.
+ * @param this The arena this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int arena_reset(Arena *const this);
+
+/**
+ * @brief Free all the memory used by the arena
+ * @param this The arena this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int arena_clear(Arena *const this);
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file atoms.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the atoms table
+ * @copyright Copyright (c) 2021
+ */
+
+#include "atoms.h"
+
+/**
+ * @brief Double the number of slots, if the table is too full
+ * @param this The atoms table
+ * @return int The return code
+ */
+int _atoms_resize(AtomTable *const this) {
+    int i;
+    int new_capacity = this->_capacity * 2;
+    unsigned long mask = (unsigned long)(new_capacity - 1);
+    AtomSlot *new_slots;
+
+    if (this->_size * 100 <= this->_capacity * ATOMS_FILL_MAX) { return 0; }
+
+    new_slots = calloc(new_capacity, sizeof(AtomSlot));
+    if (new_slots == NULL) {
+        CERR(TRUE, "Couldn't resize the atoms table");
+        return MALLOC_ERR;
+    }
+
+    for (i = 0; i < this->_capacity; ++i) {
+        if (this->_slots[i].atom != NULL) {
+            unsigned long id = hash_slot(this->_slots[i].hash, new_capacity);
+
+            while (new_slots[id].atom != NULL) { id = (id + 1) & mask; }
+            new_slots[id] = this->_slots[i];
+        }
+    }
+
+    free(this->_slots);
+    this->_slots = new_slots;
+    this->_capacity = new_capacity;
+    return 0;
+}
+
+int atomtable_init(AtomTable *const this) {
+    this->_size = 0;
+    this->_capacity = ATOMS_SIZE_START;
+    this->_slots = calloc(ATOMS_SIZE_START, sizeof(AtomSlot));
+
+    if (this->_slots == NULL) {
+        CERR(TRUE, "Couldn't init the atoms table");
+        return MALLOC_ERR;
+    }
+    return 0;
+}
+
+int atomtable_intern(AtomTable *const this, const char *text, size_t len,
+                     const Atom **atom) {
+    unsigned long h = hash_span(text, len);
+    unsigned long mask = (unsigned long)(this->_capacity - 1);
+    unsigned long id = hash_slot(h, this->_capacity);
+    Atom *new_atom;
+
+    while (this->_slots[id].atom != NULL) {
+        if (this->_slots[id].hash == h && this->_slots[id].atom->len == len &&
+            memcmp(this->_slots[id].atom->text, text, len) == 0) {
+            *atom = this->_slots[id].atom;
+            return 0;
+        }
+        id = (id + 1) & mask;
+    }
+
+    /* A new word, the atom and its text are stored together */
+    new_atom = this->_storage.alloc(&this->_storage, sizeof(Atom) + len + 1);
+    if (new_atom == NULL) { return MALLOC_ERR; }
+
+    new_atom->hash = h;
+    new_atom->len = len;
+    new_atom->id = this->_size;
+    new_atom->text = (string)(new_atom + 1);
+    memcpy(new_atom->text, text, len);
+
+    this->_slots[id].hash = h;
+    this->_slots[id].atom = new_atom;
+    this->_size++;
+
+    *atom = new_atom;
+    return _atoms_resize(this);
+}
+
+int atomtable_clear(AtomTable *const this) {
+    this->_storage.clear(&this->_storage);
+    free(this->_slots);
+
+    this->_slots = NULL;
+    this->_size = 0;
+    this->_capacity = 0;
+    return 0;
+}
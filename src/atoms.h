@@ -0,0 +1,86 @@
+/**
+ * @file atoms.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the atoms (interned words) table
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef ATOMS_H
+#define ATOMS_H
+
+#include "arena.h"
+#include "hashmap.h"
+
+#define ATOMS_SIZE_START 256 /* Initial size (must be a power of two) */
+#define ATOMS_FILL_MAX 50    /* Max fill percent */
+
+/* A "constructor" for the atoms table */
+#define INIT_ATOMTABLE                                                 \
+    {                                                                  \
+        0, 0, 0, INIT_ARENA, atomtable_init, atomtable_intern,         \
+            atomtable_clear                                            \
+    }
+
+/**
+ * @brief An interned word. There is only one atom for every distinct word, so
+ * its hash is computed only once, and the atoms can be compared by address.
+ */
+typedef struct Atom {
+    unsigned long hash; /* Computed with hash_span */
+    size_t len;
+    int id;
+    string text; /* Null-terminated */
+} Atom;
+
+/**
+ * @brief A slot of the atoms table (the hash is cached, to skip most of the
+ * words comparisons)
+ */
+typedef struct AtomSlot {
+    unsigned long hash;
+    Atom *atom;
+} AtomSlot;
+
+/**
+ * @brief The atoms table. It maps words to their atoms, which are never
+ * removed (so the addresses of the atoms are stable).
+ */
+typedef struct AtomTable {
+    AtomSlot *_slots;
+    int _size;
+    int _capacity;
+    Arena _storage; /* The memory of the atoms and of their text */
+
+    int (*init)(struct AtomTable *const this);
+    int (*intern)(struct AtomTable *const this, const char *text, size_t len,
+                  const Atom **atom);
+    int (*clear)(struct AtomTable *const this);
+} AtomTable;
+
+/**
+ * @brief Initialise the atoms table
+ * @param this The table this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int atomtable_init(AtomTable *const this);
+
+/**
+ * @brief Get the atom of a word, creating it if this is the first time the
+ * word is seen
+ * @param this The table this function is attached to
+ * @param text The start of the word (it doesn't have to be null-terminated)
+ * @param len The length of the word
+ * @param atom The atom of the word
+ * @return int The return code (0 for no errors)
+ */
+int atomtable_intern(AtomTable *const this, const char *text, size_t len,
+                     const Atom **atom);
+
+/**
+ * @brief Free all the atoms
+ * @param this The table this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int atomtable_clear(AtomTable *const this);
+
+#endif
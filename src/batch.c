@@ -0,0 +1,239 @@
+/**
+ * @file batch.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the batch mode
+ * @copyright Copyright (c) 2021
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define BATCH_USE_THREADS
+#endif
+
+#include "batch.h"
+
+#include "stats.h"
+
+#ifdef BATCH_USE_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief The inputs that are shared by the workers
+ */
+typedef struct BatchQueue {
+    CPreprocessor *base;
+    int next;     /* The next input to be processed */
+    int ret_code; /* The first error */
+#ifdef BATCH_USE_THREADS
+    pthread_mutex_t lock;
+#endif
+} BatchQueue;
+
+/**
+ * @brief Get the next input to be processed, and record the result of the
+ * previous one
+ * @param queue The queue
+ * @param ret_code The return code of the previous input
+ * @return int The index of the input (-1 if there are no inputs left)
+ */
+int _next_input(BatchQueue *const queue, int ret_code) {
+    int id = -1;
+
+#ifdef BATCH_USE_THREADS
+    pthread_mutex_lock(&queue->lock);
+#endif
+    if (ret_code != 0 && queue->ret_code == 0) { queue->ret_code = ret_code; }
+    if (queue->next < queue->base->_c_inputs) { id = queue->next++; }
+#ifdef BATCH_USE_THREADS
+    pthread_mutex_unlock(&queue->lock);
+#endif
+
+    return id;
+}
+
+/**
+ * @brief Get the name of an input (its path, without the directories)
+ * @param input The input path
+ * @return const char* The name (a part of the path)
+ */
+const char *_input_name(const char *input) {
+    const char *name = input + strlen(input);
+
+    while (name != input && name[-1] != '/' && name[-1] != '\\') { name--; }
+    return name;
+}
+
+/**
+ * @brief Compare the names of two inputs (for qsort)
+ * @param a The first input
+ * @param b The second input
+ * @return int The order of the names
+ */
+int _compare_names(const void *a, const void *b) {
+    return strcmp(_input_name(*(const char *const *)a),
+                  _input_name(*(const char *const *)b));
+}
+
+/**
+ * @brief Check that the outputs of the inputs are different files. The outputs
+ * keep only the names of the inputs, so two inputs with the same name (from
+ * different directories, or given twice) would be written in the same file,
+ * by different workers.
+ * @param base The preprocessor that parsed the command line
+ * @return int The return code (FILE_ERR if two inputs have the same name)
+ */
+int _check_outputs(CPreprocessor *const base) {
+    const char **sorted;
+    int ret_code = 0;
+    int i;
+
+    sorted = calloc(base->_c_inputs, sizeof(const char *));
+    if (sorted == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the inputs");
+        return MALLOC_ERR;
+    }
+
+    for (i = 0; i < base->_c_inputs; ++i) { sorted[i] = base->inputs[i]; }
+    qsort(sorted, base->_c_inputs, sizeof(const char *), _compare_names);
+
+    for (i = 1; i < base->_c_inputs; ++i) {
+        if (_compare_names(&sorted[i - 1], &sorted[i]) == 0) {
+            CERR(TRUE, "Two inputs have the same name (and output)");
+            ret_code = FILE_ERR;
+            break;
+        }
+    }
+
+    free((void *)sorted);
+    return ret_code;
+}
+
+/**
+ * @brief Compute the path of the output of an input (the input name, in the
+ * output directory)
+ * @param outdir The output directory
+ * @param input The input path
+ * @param output The output path (must be freed)
+ * @return int The return code
+ */
+int _output_path(string outdir, string input, string *output) {
+    const char *name = _input_name(input);
+    size_t dir_len = strlen(outdir);
+
+    *output = calloc(dir_len + strlen(name) + 2, 1);
+    if (*output == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the output path");
+        return MALLOC_ERR;
+    }
+
+    strcpy(*output, outdir);
+    (*output)[dir_len] = '/';
+    strcpy(*output + dir_len + 1, name);
+    return 0;
+}
+
+/**
+ * @brief A worker. It takes inputs from the queue until all of them are
+ * processed
+ * @param arg The queue
+ * @return void* Nothing
+ */
+void *_batch_worker(void *arg) {
+    BatchQueue *const queue = arg;
+    CPreprocessor proc;
+    string output;
+    int ret_code;
+    int id;
+
+    ret_code = cpreprocessor_init_worker(&proc, queue->base);
+    if (ret_code != 0) {
+        _next_input(queue, ret_code);
+        return NULL;
+    }
+
+    while ((id = _next_input(queue, ret_code)) != -1) {
+        string input = queue->base->inputs[id];
+
+        ret_code = _output_path(queue->base->outdir, input, &output);
+        if (ret_code != 0) { continue; }
+
+        ret_code = cpreprocessor_process(&proc, input, output);
+        if (ret_code != 0) { DEBUG_MSG("Couldn't preprocess an input"); }
+        free(output);
+    }
+
+    proc.clear(&proc);
+    return NULL;
+}
+
+/**
+ * @brief Compute the number of workers
+ * @param base The preprocessor that parsed the command line
+ * @return int The number of workers
+ */
+int _count_jobs(CPreprocessor *const base) {
+    long jobs = base->jobs;
+
+#ifdef BATCH_USE_THREADS
+    if (jobs <= 0) { jobs = sysconf(_SC_NPROCESSORS_ONLN); }
+#endif
+
+    if (jobs > base->_c_inputs) { jobs = base->_c_inputs; }
+    if (jobs > BATCH_JOBS_MAX) { jobs = BATCH_JOBS_MAX; }
+    if (jobs < 1) { jobs = 1; }
+
+    /* The statistics counters are not shared safely between threads */
+    if (STATS_MODE && stats.enabled) { jobs = 1; }
+    return (int)jobs;
+}
+
+int batch_run(CPreprocessor *const base) {
+    BatchQueue queue;
+#ifdef BATCH_USE_THREADS
+    pthread_t *threads;
+    int jobs = _count_jobs(base);
+    int started = 0;
+    int i;
+#endif
+    int ret_code;
+
+    /* Nothing is written if two inputs would overwrite each other */
+    ret_code = _check_outputs(base);
+    if (ret_code != 0) { return ret_code; }
+
+    queue.base = base;
+    queue.next = 0;
+    queue.ret_code = 0;
+
+#ifdef BATCH_USE_THREADS
+    threads = calloc(jobs, sizeof(pthread_t));
+    if (threads == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the workers");
+        return MALLOC_ERR;
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+
+    /* The current thread is also a worker */
+    for (i = 1; i < jobs; ++i) {
+        if (pthread_create(&threads[started], NULL, _batch_worker, &queue) !=
+            0) {
+            DEBUG_MSG("Couldn't start a worker");
+            break;
+        }
+        started++;
+    }
+
+    _batch_worker(&queue);
+
+    for (i = 0; i < started; ++i) { pthread_join(threads[i], NULL); }
+
+    pthread_mutex_destroy(&queue.lock);
+    free(threads);
+#else
+    _batch_worker(&queue);
+#endif
+
+    return queue.ret_code;
+}
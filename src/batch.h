@@ -0,0 +1,27 @@
+/**
+ * @file batch.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the batch mode
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "cpreprocessor.h"
+
+#define BATCH_JOBS_MAX 256 /* The maximum number of workers */
+
+/**
+ * @brief Preprocess all the inputs of the preprocessor, on a pool of workers
+ * (one for every core, if the number of workers was not specified). Every
+ * input is written in the output directory, with the same name as the input
+ * (so the names of the inputs must be different, or nothing is processed).
+ * The workers share the macros and include directories from the command line,
+ * and every input starts from that state.
+ * @param base The preprocessor that parsed the command line
+ * @return int The return code (the first error, if some inputs failed)
+ */
+int batch_run(CPreprocessor *const base);
+
+#endif
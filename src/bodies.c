@@ -0,0 +1,162 @@
+/**
+ * @file bodies.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the pre-parsed macro bodies
+ * @copyright Copyright (c) 2021
+ */
+
+#include "bodies.h"
+
+/**
+ * @brief Append a piece to the body that is being parsed. A text piece that
+ * follows another one extends it.
+ * @param this The cache
+ * @param count The number of pieces of the body
+ * @param piece The new piece
+ * @return int The return code
+ */
+int _add_piece(BodyCache *const this, int *count, const BodyPiece *piece) {
+    BodyPiece *last = *count != 0 ? &this->_pieces[*count - 1] : NULL;
+
+    if (piece->kind == PIECE_TEXT && last != NULL && last->kind == PIECE_TEXT) {
+        last->len += piece->len;
+        return 0;
+    }
+
+    if (*count == this->_pieces_cap) {
+        int new_cap = this->_pieces_cap == 0 ? 16 : this->_pieces_cap * 2;
+        BodyPiece *aux_buff =
+            realloc(this->_pieces, new_cap * sizeof(BodyPiece));
+
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the macro body");
+            return MALLOC_ERR;
+        }
+        this->_pieces = aux_buff;
+        this->_pieces_cap = new_cap;
+    }
+
+    this->_pieces[(*count)++] = *piece;
+    return 0;
+}
+
+/**
+ * @brief Split a body into pieces, and store it
+ * @param this The cache
+ * @param atoms The table used to intern the identifiers
+ * @param text The body text (interned in the texts of the cache)
+ * @param params The parameters (of a function-like macro)
+ * @param c_params The number of parameters
+ * @param body The stored body
+ * @return int The return code
+ */
+int _parse_body(BodyCache *const this, AtomTable *const atoms,
+                const Atom *text, const Atom *const *params, int c_params,
+                MacroBody **body) {
+    Lexer lexer = INIT_LEXER;
+    Token token;
+    BodyPiece piece;
+    int count = 0;
+    int ret_code = 0;
+    int i;
+
+    lexer_start(&lexer, text->text, text->len);
+    while (ret_code == 0 && lexer_next(&lexer, &token)) {
+        piece.kind = PIECE_TEXT;
+        piece.start = token.start;
+        piece.len = token.len;
+        piece.atom = NULL;
+        piece.param = 0;
+
+        if (token.kind == TOKEN_IDENT) {
+            ret_code = atoms->intern(atoms, text->text + token.start,
+                                     token.len, &piece.atom);
+            if (ret_code < 0) { return ret_code; }
+            piece.kind = PIECE_WORD;
+
+            for (i = 0; i < c_params; ++i) {
+                if (params[i] == piece.atom) {
+                    piece.kind = PIECE_PARAM;
+                    piece.param = i;
+                    break;
+                }
+            }
+        }
+
+        ret_code = _add_piece(this, &count, &piece);
+    }
+    if (ret_code < 0) { return ret_code; }
+
+    *body = this->_storage.alloc(&this->_storage,
+                                 sizeof(MacroBody) + count * sizeof(BodyPiece));
+    if (*body == NULL) { return MALLOC_ERR; }
+
+    (*body)->text = text->text;
+    (*body)->count = count;
+    (*body)->pieces = (BodyPiece *)(*body + 1);
+    if (count != 0) {
+        memcpy((*body)->pieces, this->_pieces, count * sizeof(BodyPiece));
+    }
+    return 0;
+}
+
+int bodycache_parse(BodyCache *const this, AtomTable *const atoms,
+                    const char *text, const Atom *const *params, int c_params,
+                    const MacroBody **body) {
+    const Atom *key;
+    MacroBody *parsed;
+    int ret_code;
+
+    /* The text is kept by the cache, as long as its body */
+    if (this->_texts._slots == NULL) {
+        ret_code = this->_texts.init(&this->_texts);
+        if (ret_code < 0) { return ret_code; }
+    }
+    ret_code = this->_texts.intern(&this->_texts, text, strlen(text), &key);
+    if (ret_code < 0) { return ret_code; }
+
+    if (c_params != 0) {
+        ret_code = _parse_body(this, atoms, key, params, c_params, &parsed);
+        *body = parsed;
+        return ret_code;
+    }
+
+    if (key->id >= this->_capacity) {
+        int new_capacity = this->_capacity == 0 ? 64 : this->_capacity;
+        MacroBody **aux_buff;
+
+        while (new_capacity <= key->id) { new_capacity *= 2; }
+        aux_buff = realloc(this->_bodies, new_capacity * sizeof(MacroBody *));
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the macro bodies");
+            return MALLOC_ERR;
+        }
+
+        memset(aux_buff + this->_capacity, 0,
+               (new_capacity - this->_capacity) * sizeof(MacroBody *));
+        this->_bodies = aux_buff;
+        this->_capacity = new_capacity;
+    }
+
+    if (this->_bodies[key->id] == NULL) {
+        ret_code = _parse_body(this, atoms, key, NULL, 0,
+                               &this->_bodies[key->id]);
+        if (ret_code < 0) { return ret_code; }
+    }
+
+    *body = this->_bodies[key->id];
+    return 0;
+}
+
+int bodycache_clear(BodyCache *const this) {
+    this->_texts.clear(&this->_texts);
+    this->_storage.clear(&this->_storage);
+    free(this->_bodies);
+    free(this->_pieces);
+
+    this->_bodies = NULL;
+    this->_pieces = NULL;
+    this->_capacity = 0;
+    this->_pieces_cap = 0;
+    return 0;
+}
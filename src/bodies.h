@@ -0,0 +1,93 @@
+/**
+ * @file bodies.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the pre-parsed macro bodies (the
+ * replacement lists)
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef BODIES_H
+#define BODIES_H
+
+#include "arena.h"
+#include "atoms.h"
+#include "lexer.h"
+
+/* A "constructor" for the bodies cache */
+#define INIT_BODYCACHE                                                   \
+    {                                                                    \
+        0, 0, INIT_ATOMTABLE, INIT_ARENA, 0, 0, bodycache_parse,         \
+            bodycache_clear                                              \
+    }
+
+/* The kinds of pieces of a body */
+#define PIECE_TEXT 0  /* A span of the body, copied as it is */
+#define PIECE_WORD 1  /* An identifier, that can be a macro */
+#define PIECE_PARAM 2 /* A parameter of a function-like macro */
+
+/**
+ * @brief A piece of a macro body. Every piece is a span of the body text.
+ */
+typedef struct BodyPiece {
+    int kind;
+    size_t start;
+    size_t len;
+    const Atom *atom; /* The identifier (PIECE_WORD) */
+    int param;        /* The index of the parameter (PIECE_PARAM) */
+} BodyPiece;
+
+/**
+ * @brief A macro body, split into the pieces that are copied, and the ones
+ * that are replaced when the macro is expanded. The neighbouring delimiters
+ * and literals are merged into a single text piece.
+ */
+typedef struct MacroBody {
+    const char *text; /* The text of the body (owned by the cache) */
+    int count;
+    BodyPiece *pieces;
+} MacroBody;
+
+/**
+ * @brief The cache of the parsed bodies. Every body (of an object-like macro)
+ * is parsed once, and found again by its text, so the macros with the same
+ * body share it. The texts have their own table, apart from the identifiers.
+ */
+typedef struct BodyCache {
+    MacroBody **_bodies; /* Indexed by the ids of the texts */
+    int _capacity;
+    AtomTable _texts;    /* The texts of the bodies */
+    Arena _storage;      /* The memory of the parsed bodies */
+    BodyPiece *_pieces;  /* The pieces of the body that is being parsed */
+    int _pieces_cap;
+
+    int (*parse)(struct BodyCache *const this, AtomTable *const atoms,
+                 const char *text, const Atom *const *params, int c_params,
+                 const MacroBody **body);
+    int (*clear)(struct BodyCache *const this);
+} BodyCache;
+
+/**
+ * @brief Get the parsed body of a macro, parsing it if this is the first time
+ * it is seen. The identifiers are split with the line lexer, so the body is
+ * cut in the same places as the lines that use the macro.
+ * @param this The cache this function is attached to
+ * @param atoms The table used to intern the identifiers
+ * @param text The body text
+ * @param params The parameters of a function-like macro (their identifiers
+ * become PIECE_PARAM pieces). The bodies with parameters are not cached.
+ * @param c_params The number of parameters (0 for object-like macros)
+ * @param body The parsed body (valid until the cache is cleared)
+ * @return int The return code (0 for no errors)
+ */
+int bodycache_parse(BodyCache *const this, AtomTable *const atoms,
+                    const char *text, const Atom *const *params, int c_params,
+                    const MacroBody **body);
+
+/**
+ * @brief Free all the parsed bodies
+ * @param this The cache this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int bodycache_clear(BodyCache *const this);
+
+#endif
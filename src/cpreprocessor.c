@@ -7,6 +7,15 @@
 
 #include "cpreprocessor.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "batch.h"
+#include "deps.h"
+#include "server.h"
+#include "stats.h"
+
 /**
  * @brief Set the input file
  * @param this The processor
@@ -46,185 +55,294 @@ int set_output(CPreprocessor *const this, string output) {
 }
 
 /**
- * @brief Add a include path
- * @param this The preprocessor
- * @param new_include The new included path
+ * @brief Add a path to a list of paths
+ * @param paths The list of paths
+ * @param count The number of paths in the list
+ * @param new_path The new path
  * @return int The return code
  */
-int add_include(CPreprocessor *const this, string new_include) {
-    int id = this->_c_includes;
+int _add_path(string **paths, int *count, string new_path) {
+    int id = *count;
     int i;
     string *aux_buff;
 
-    this->_c_includes++;
+    (*count)++;
 
     /* Add space for the new path */
-    aux_buff = realloc(this->includes, this->_c_includes * sizeof(string));
+    aux_buff = realloc(*paths, *count * sizeof(string));
     if (aux_buff == NULL) {
         /* Realloc failed. Free all the paths here */
-        for (i = 0; i < this->_c_includes; ++i) { free(this->includes[i]); }
-        free(this->includes);
-        this->_c_includes = 0;
-        this->includes = aux_buff;
-        CERR(TRUE, "Couldn't add a space for a new directory");
+        for (i = 0; i < id; ++i) { free((*paths)[i]); }
+        free(*paths);
+        *count = 0;
+        *paths = aux_buff;
+        CERR(TRUE, "Couldn't add a space for a new path");
         return MALLOC_ERR;
     }
-    this->includes = aux_buff;
+    *paths = aux_buff;
 
-    /* Add the include directory */
-    this->includes[id] =
-        strcpy(calloc(1, strlen(new_include) + 1), new_include);
+    /* Add the path */
+    (*paths)[id] = calloc(1, strlen(new_path) + 1);
 
-    if (this->includes[id] == NULL) {
+    if ((*paths)[id] == NULL) {
         /* Mallocs failed */
-        this->_c_includes--;
-        CERR(TRUE, "Couldn't set one of the include directories");
+        (*count)--;
+        CERR(TRUE, "Couldn't add the path");
         return MALLOC_ERR;
     }
+    strcpy((*paths)[id], new_path);
 
     return 0;
 }
 
 /**
- * @brief Add a define to the list, in the key=value format
- * @param this The cpreprocessor
- * @param key_value The key_value (a string of the key=value format)
+ * @brief Add a include path
+ * @param this The preprocessor
+ * @param new_include The new included path
  * @return int The return code
  */
-int add_define(CPreprocessor *const this, string key_value) {
-    string d_key;
-    string d_value;
-    StringsPair p;
-    int ret_code;
-
-    d_key = strtok(key_value, "= ");
-    d_value = strtok(NULL, "");
+int add_include(CPreprocessor *const this, string new_include) {
+    return _add_path(&this->includes, &this->_c_includes, new_include);
+}
 
-    /* In case the definition had no value */
-    if (d_value == NULL) { d_value = ""; }
+/**
+ * @brief Add an input for the batch mode
+ * @param this The preprocessor
+ * @param new_input The new input file
+ * @return int The return code
+ */
+int add_input(CPreprocessor *const this, string new_input) {
+    return _add_path(&this->inputs, &this->_c_inputs, new_input);
+}
 
-    /* Create the pair */
-    ret_code = make_spair(d_key, d_value, &p);
-    if (ret_code < 0) { return ret_code; }
+/**
+ * @brief Load the macros of a snapshot. They are shared by all the inputs, and
+ * are searched after the macros defined by the inputs (and on the command line)
+ * @param this The processor
+ * @param path The path of the snapshot
+ * @return int The return code
+ */
+int load_snapshot(CPreprocessor *const this, string path) {
+    Snapshot new_snapshot = INIT_SNAPSHOT;
+    int ret_code;
 
-    /* Add the pair in the map, then clear the memory used
-     * "locally" */
-    this->map.put(&this->map, p);
-    ret_code = clear_spair(&p);
-    if (ret_code < 0) { return ret_code; }
+    if (this->snapshot != NULL) {
+        this->snapshot->clear(this->snapshot);
+    } else {
+        this->snapshot = malloc(sizeof(Snapshot));
+        if (this->snapshot == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the snapshot");
+            return MALLOC_ERR;
+        }
+    }
+    *this->snapshot = new_snapshot;
 
-    return 0;
+    ret_code = this->snapshot->load(this->snapshot, path);
+    if (ret_code != 0) {
+        free(this->snapshot);
+        this->snapshot = NULL;
+    }
+    return ret_code;
 }
 
 /**
- * @brief Concatenate two strings into the "dest" string
- * @param dest The result of the concatentation
- * @param first The first string
- * @param second The second string
+ * @brief Save all the macros that are defined into a snapshot
+ * @param this The processor
+ * @param path The path of the snapshot
  * @return int The return code
  */
-int concatentate(string *dest, string first, string second) {
-    size_t len1, len2;
-    string s1 = strcpy(calloc(strlen(first) + 1, 1), first);
-    string s2 = strcpy(calloc(strlen(second) + 1, 1), second);
+int save_snapshot(CPreprocessor *const this, string path) {
+    Hashmap macros = INIT_HASHMAP;
+    const StringsPair *pair;
+    StringsPair macro;
+    unsigned long s_pos = 0;
+    int pos = 0;
+    int ret_code;
 
-    if (s1 == NULL || s2 == NULL) {
-        CERR(TRUE, "Couldn't allocate memory for the strings");
-        free(s1);
-        free(s2);
-        return MALLOC_ERR;
+    ret_code = macros.init(&macros);
+
+    /* The loaded snapshot, without the macros the input undefined */
+    while (ret_code == 0 && this->snapshot != NULL &&
+           this->snapshot->next(this->snapshot, &s_pos, &macro.first,
+                                &macro.second) == 0) {
+        if (this->undefs.find(&this->undefs, macro.first, &pair) != 0) {
+            ret_code = macros.put(&macros, macro);
+        }
     }
 
-    len1 = strlen(s1);
-    len2 = strlen(s2);
+    /* The macros defined on the command line and by the input */
+    while (ret_code == 0 && this->map.next(&this->map, &pos, &pair) == 0) {
+        ret_code = macros.put(&macros, *pair);
+    }
 
-    free(*dest);
-    *dest = strcpy(calloc(len1 + len2 + 1, sizeof(char)), s1);
+    if (ret_code == 0) { ret_code = snapshot_save(&macros, path); }
 
-    if (*dest == NULL) {
-        CERR(TRUE, "Couldn't allocate memory for the string");
-        free(s1);
-        free(s2);
+    macros.clear(&macros);
+    return ret_code;
+}
+
+/**
+ * @brief Replace a string option with a copy of the new value
+ * @param option The option
+ * @param value The new value
+ * @return int The return code
+ */
+int _set_string(string *option, string value) {
+    free(*option);
+    *option = calloc(1, strlen(value) + 1);
+    if (*option == NULL) {
+        /* Mallocs failed */
+        CERR(TRUE, "Couldn't set the option");
         return MALLOC_ERR;
     }
 
-    if (strcat(*dest, s2) == NULL) {
-        CERR(TRUE, "Couldn't concatenate the strings");
-        free(s1);
-        free(s2);
-        return 1;
+    strcpy(*option, value);
+    return 0;
+}
+
+/**
+ * @brief Set the socket of the server
+ * @param this The processor
+ * @param socket The path of the socket
+ * @return int The return code
+ */
+int set_socket(CPreprocessor *const this, string socket) {
+    return _set_string(&this->socket, socket);
+}
+
+/**
+ * @brief Set the output directory (this enables the batch mode)
+ * @param this The processor
+ * @param outdir The output directory
+ * @return int The return code
+ */
+int set_outdir(CPreprocessor *const this, string outdir) {
+    return _set_string(&this->outdir, outdir);
+}
+
+/**
+ * @brief Set the number of workers of the batch mode
+ * @param this The processor
+ * @param jobs The number of workers (a positive number)
+ * @return int The return code
+ */
+int set_jobs(CPreprocessor *const this, string jobs) {
+    string end;
+    long count;
+
+    errno = 0;
+    count = strtol(jobs, &end, 10);
+    if (end == jobs || *end != '\0' || errno == ERANGE || count <= 0 ||
+        count > INT_MAX) {
+        CERR(TRUE, "Invalid number of workers");
+        return FILE_ERR;
     }
 
-    free(s1);
-    free(s2);
+    this->jobs = (int)count;
     return 0;
 }
 
+int _dependent_list(CPreprocessor *const proc, const Atom *word,
+                    DependentList **list);
+
 /**
- * @brief Open a file and return it's file descriptor
- * @param path The path to the input
- * @param fd The returned file descriptor
- * @param proc The preprocessor "object"
+ * @brief Get the replacement list of a macro value. The lists are cached by
+ * the text of the value, so they are parsed only when the macro is defined
+ * (or, for the shared macros, the first time they are used)
+ * @param this The cpreprocessor
+ * @param value The value of the macro
+ * @param body The replacement list
  * @return int The return code
  */
-int open_input(string path, FILE **fd, CPreprocessor *const proc) {
-    /* Find the file. */
-    int i;
-    int ret_val;
+int _macro_body(CPreprocessor *const this, string value,
+                 const MacroBody **body) {
+    return this->bodies.parse(&this->bodies, &this->atoms, value, NULL, 0,
+                              body);
+}
 
-    if (strcmp(path, proc->input) == 0) {
-        /* The input file must not be searched in the include directories */
-        *fd = fopen(path, "r");
+/**
+ * @brief Add a define to the list, in the key=value format
+ * @param this The cpreprocessor
+ * @param key_value The key_value (a string of the key=value format)
+ * @return int The return code
+ */
+int add_define(CPreprocessor *const this, string key_value) {
+    string d_key;
+    string d_value;
+    StringsPair p;
+    const MacroBody *body;
+    const Atom *atom;
+    DependentList *list;
+    int ret_code;
 
-        if (*fd == NULL) {
-            CERR(TRUE, "Couldn't open file");
-            return 1;
-        }
-        return 0;
-    } else {
-        /* The included files need to be (eventually) searched */
-        FILE *check;
+    /* The workers define macros at the same time, so the definition is split
+     * in place (strtok keeps its position in a global) */
+    d_key = key_value + strspn(key_value, "= ");
+    if (*d_key == '\0') {
+        CERR(TRUE, "Missing macro name");
+        return FILE_ERR;
+    }
 
-        if ((check = fopen(path, "r"))) {
-            fclose(check);
-            *fd = fopen(path, "r");
-        } else {
-            /* Try the include folders */
-            for (i = 0; i < proc->_c_includes; ++i) {
-                string i_path = calloc(1, sizeof(char));
-                if (i_path == NULL) {
-                    CERR(TRUE, "Couldn't allocate memory");
-                    return MALLOC_ERR;
-                }
+    /* In case the definition had no value, it is empty (the spaces before the
+     * value are not part of it) */
+    d_value = d_key + strcspn(d_key, "= ");
+    if (*d_value != '\0') { *d_value++ = '\0'; }
+    d_value += strspn(d_value, " \t");
+
+    /* Split the value into its replacement list, once, and keep it with the
+     * macro, for its expansions */
+    ret_code = _macro_body(this, d_value, &body);
+    if (ret_code == 0) {
+        ret_code = this->atoms.intern(&this->atoms, d_key, strlen(d_key), &atom);
+    }
+    if (ret_code == 0) { ret_code = _dependent_list(this, atom, &list); }
+    if (ret_code < 0) { return ret_code; }
+    list->body = body;
 
-                /* Compute the "include" path */
-                ret_val = concatentate(&i_path, proc->includes[i], "/");
-                if (ret_val != 0) {
-                    free(i_path);
-                    return ret_val;
-                }
+    /* Create the pair */
+    ret_code = make_spair(d_key, d_value, &p);
+    if (ret_code < 0) { return ret_code; }
 
-                ret_val = concatentate(&i_path, i_path, path);
-                if (ret_val != 0) {
-                    free(i_path);
-                    return ret_val;
-                }
+    /* Move the pair in the map (the strings are not copied again) */
+    return this->map.put_owned(&this->map, &p);
+}
 
-                /* Check that the "include" path exists */
-                if ((check = fopen(i_path, "r"))) {
-                    fclose(check);
-                    *fd = fopen(i_path, "r");
-                    free(i_path);
-                    return 0;
-                }
+/**
+ * @brief Add a define from the command line. The argument is tokenized on a
+ * copy, as the client of the server forwards the arguments after parsing them
+ * @param this The processor
+ * @param key_value The "key=value" argument
+ * @return int The return code
+ */
+int add_define_arg(CPreprocessor *const this, string key_value) {
+    string copy = calloc(strlen(key_value) + 1, 1);
+    int ret_code;
 
-                free(i_path);
-            }
-        }
+    if (copy == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the define");
+        return MALLOC_ERR;
     }
 
-    DEBUG_MSG("Couldn't find file");
-    return 1;
+    ret_code = add_define(this, strcpy(copy, key_value));
+    free(copy);
+    return ret_code;
+}
+
+/**
+ * @brief Open the input file and return it's file descriptor. The included
+ * files are searched and read by _process_includes.
+ * @param path The path to the input
+ * @param fd The returned file descriptor
+ * @return int The return code
+ */
+int open_input(string path, FILE **fd) {
+    *fd = fopen(path, "r");
+
+    if (*fd == NULL) {
+        CERR(TRUE, "Couldn't open file");
+        return FILE_ERR;
+    }
+    return 0;
 }
 
 /**
@@ -244,113 +362,62 @@ int close_file(FILE *fd) {
 }
 
 /**
- * @brief Reads a line into the line buffer, from the input. (it takes into
- * account the line continuation character)
- * @param line The read line
- * @param input The input FILE
- * @return int The return code (0 for EOF, 1 for Success, others for errors)
+ * @brief Add the inputs listed in a response file (one path on every line)
+ * @param this The preprocessor
+ * @param path The path of the response file
+ * @return int The return code
  */
-int read_line(string *line, FILE *input) {
-    string buffer = calloc(BUFFER_SIZE, sizeof(char));
-    string line_start;
-    int ret_code;
-    int had_multi = FALSE;
-
-    free(*line);
-    *line = calloc(BUFFER_SIZE, sizeof(char));
-    if (buffer == NULL) {
-        CERR(TRUE, "Couldn't allocate memory");
-        return MALLOC_ERR;
-    }
-
-    /* While we can read and the current line is not continued, keep reading */
-    while ((fgets(buffer, BUFFER_SIZE, input) != NULL)) {
-        size_t len = strlen(buffer);
-        if (len > 1) {
-            if (buffer[len - 2] == '\\') {
-                had_multi = TRUE;
-
-                /* Line must be continued */
-                buffer[len - 2] = '\0';
-                line_start = buffer;
-
-                /* Remove tabs or spaces from the start of the line */
-                while (line_start[0] == '\t' || line_start[0] == ' ') {
-                    line_start++;
-                }
-
-                ret_code = concatentate(line, *line, line_start);
+int add_inputs_file(CPreprocessor *const this, string path) {
+    InputReader reader = INIT_READER;
+    FILE *file;
+    const char *line;
+    size_t len;
+    string input;
+    int ret_code, read_code = 0;
+
+    ret_code = open_input(path, &file);
+    if (ret_code != 0) { return ret_code; }
 
-                if (ret_code != 0) {
-                    free(buffer);
-                    return ret_code;
-                }
+    ret_code = reader.open(&reader, file);
+    close_file(file);
 
-                /* Read next line */
-                continue;
-            }
+    while (ret_code == 0 &&
+           (read_code = reader.next_line(&reader, &line, &len)) == 1) {
+        /* Skip the blanks around the path */
+        while (len != 0 && isspace((uchar)line[len - 1])) { len--; }
+        while (len != 0 && isspace((uchar)*line)) {
+            line++;
+            len--;
         }
+        if (len == 0) { continue; }
 
-        line_start = buffer;
-        /* Remove tabs or spaces from the start of the line */
-        if (had_multi) {
-            while (line_start[0] == '\t' || line_start[0] == ' ') {
-                line_start++;
-            }
+        input = calloc(len + 1, 1);
+        if (input == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the input");
+            ret_code = MALLOC_ERR;
+            break;
         }
+        memcpy(input, line, len);
 
-        /* The line is ended */
-        ret_code = concatentate(line, *line, line_start);
-
-        if (ret_code != 0) {
-            free(buffer);
-            return ret_code;
-        }
-        free(buffer);
-        return 1;
+        ret_code = add_input(this, input);
+        free(input);
     }
 
-    free(buffer);
-    return 0;
+    reader.close(&reader);
+    if (ret_code == 0 && read_code < 0) { ret_code = read_code; }
+    return ret_code;
 }
 
 /**
  * @brief Helper functions used by the process_input function, to allocate the
  * memory for the different buffers/arrays
- * @param buffer The buffer used to store the original line
- * @param line The buffer for the line that will be tokenized
- * @param expansion The buffer for the expansion of a macro
+ * @param ifs The states of the opened #if groups
  * @return int The return code
  */
-int _allocate_process_data(string *buffer, string *line, string *expansion,
-                           int **ifs) {
-    *buffer = calloc(BUFFER_SIZE, sizeof(char));
-    if (*buffer == NULL) {
-        CERR(TRUE, "Couldn't allocate memory");
-        return MALLOC_ERR;
-    }
-
-    *line = calloc(BUFFER_SIZE, sizeof(char));
-    if (*line == NULL) {
-        CERR(TRUE, "Couldn't allocate memory");
-        free(*buffer);
-        return MALLOC_ERR;
-    }
-
-    *expansion = calloc(BUFFER_SIZE, sizeof(char));
-    if (*expansion == NULL) {
-        CERR(TRUE, "Couldn't allocate memory");
-        free(*buffer);
-        free(*line);
-        return MALLOC_ERR;
-    }
-
+int _allocate_process_data(int **ifs) {
     *ifs = calloc(BUFFER_SIZE, sizeof(int));
     if (*ifs == NULL) {
         CERR(TRUE, "Couldn't allocate memory");
-        free(*buffer);
-        free(*line);
-        free(*expansion);
         return MALLOC_ERR;
     }
 
@@ -360,20 +427,63 @@ int _allocate_process_data(string *buffer, string *line, string *expansion,
 /**
  * @brief Helper functions used by the process_input function, to free the
  * memory for the different buffers/arrays
- * @param buffer The buffer used to store the original line
- * @param line The buffer for the line that will be tokenized
- * @param expansion The buffer for the expansion of a macro
+ * @param expansion The builder used for the expansions of the macros
+ * @param ifs The states of the opened #if groups
  * @return int The return code
  */
-int _free_process_data(string *buffer, string *line, string *expansion,
-                       int **ifs) {
-    free(*buffer);
-    free(*line);
-    free(*expansion);
+int _free_process_data(StringBuilder *expansion, int **ifs) {
+    expansion->clear(expansion);
     free(*ifs);
     return 0;
 }
 
+/**
+ * @brief Find a macro in the shared (read-only) macros: the command line
+ * macros of the batch workers, and the loaded snapshot
+ * @param proc The processor that uses this function
+ * @param key The name of the macro
+ * @param h The hash of the name
+ * @param value The value of the macro
+ * @return int The return code (0 - exists, 1 - doesn't exist)
+ */
+int _find_shared(CPreprocessor *const proc, string key, unsigned long h,
+                 string *value) {
+    const StringsPair *pair;
+
+    if (proc->_base != NULL &&
+        proc->_base->find_hashed(proc->_base, key, h, &pair) == 0) {
+        *value = pair->second;
+        return 0;
+    }
+
+    if (proc->snapshot != NULL) {
+        return proc->snapshot->find(proc->snapshot, key, h, value);
+    }
+    return 1;
+}
+
+/**
+ * @brief Find the definition of a macro. The macros defined by the input are
+ * searched first, then the shared macros (unless the input undefined them)
+ * @param proc The processor that uses this function
+ * @param key The name of the macro
+ * @param h The hash of the name
+ * @param value The value of the macro (it must not be modified)
+ * @return int The return code (0 - exists, 1 - doesn't exist)
+ */
+int _find_macro(CPreprocessor *const proc, string key, unsigned long h,
+                string *value) {
+    const StringsPair *pair;
+
+    if (proc->map.find_hashed(&proc->map, key, h, &pair) == 0) {
+        *value = pair->second;
+        return 0;
+    }
+    if (_find_shared(proc, key, h, value) != 0) { return 1; }
+
+    return proc->undefs.find_hashed(&proc->undefs, key, h, &pair) == 0;
+}
+
 /**
  * @brief Check if the key is defined
  * @param proc The processor that uses this function
@@ -382,401 +492,758 @@ int _free_process_data(string *buffer, string *line, string *expansion,
  * error)
  */
 int is_defined(CPreprocessor *const proc, string key) {
-    int ret_code;
-    StringsPair pair;
+    string value;
 
     if (key == NULL) { return 1; }
 
-    ret_code = proc->map.get(&proc->map, key, &pair);
-    if (ret_code < 0) { return ret_code; }
+    return _find_macro(proc, key, hash(key), &value);
+}
 
-    if (strcmp(pair.first, key) == 0) {
-        ret_code = 0;
-    } else {
-        ret_code = 1;
+/**
+ * @brief Get the list of the macros that depend on a word (the index grows,
+ * if the word is new)
+ * @param proc The processor that uses this function
+ * @param word The word
+ * @param list The list of the word
+ * @return int The return code
+ */
+int _dependent_list(CPreprocessor *const proc, const Atom *word,
+                    DependentList **list) {
+    if (word->id >= proc->_c_dependents) {
+        int new_count =
+            proc->_c_dependents == 0 ? 64 : proc->_c_dependents;
+        DependentList *aux_buff;
+
+        while (new_count <= word->id) { new_count *= 2; }
+        aux_buff =
+            realloc(proc->dependents, new_count * sizeof(DependentList));
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the dependents");
+            return MALLOC_ERR;
+        }
+
+        memset(aux_buff + proc->_c_dependents, 0,
+               (new_count - proc->_c_dependents) * sizeof(DependentList));
+        proc->dependents = aux_buff;
+        proc->_c_dependents = new_count;
     }
 
-    clear_spair(&pair);
-    return ret_code;
+    *list = &proc->dependents[word->id];
+    return 0;
 }
 
 /**
- * @brief Tokenize a string
- * @param source The string
- * @param delims The delimitators
- * @param delim The delimitator that was found
- * @return string The token
+ * @brief Free the lists of dependents
+ * @param proc The processor that uses this function
  */
-string simple_tok(string *source, string delims, string *delim) {
-    size_t s_l, d_l;
-    string start = *source;
-    unsigned int i, j;
-
-    if (*source == NULL) { return NULL; }
-    s_l = strlen(*source);
-    d_l = strlen(delims);
+void _clear_dependents(CPreprocessor *const proc) {
+    int i;
 
-    for (i = 0; i < s_l; ++i) {
-        for (j = 0; j < d_l; ++j) {
-            if ((*source + i)[0] == delims[j]) {
-                (*source + i)[0] = '\0';
-                (*delim)[0] = delims[j];
-                *source = *source + i + 1;
-                return start;
-            }
-        }
+    for (i = 0; i < proc->_c_dependents; ++i) {
+        free((void *)proc->dependents[i].macros);
     }
+    free(proc->dependents);
 
-    *source = NULL;
-    return start;
+    proc->dependents = NULL;
+    proc->_c_dependents = 0;
 }
 
 /**
- * @brief Try to expand the specified string. If it can't code 1 is returned.
+ * @brief Record that the cached expansion of a macro depends on a word (if the
+ * word is defined/undefined, the expansion must be invalidated)
  * @param proc The processor that uses this function
- * @param key The key/word to expand
- * @param expansion The result
- * @return int The return code (1 for no expansion, 0 for success)
+ * @param word The word the expansion depends on
+ * @param macro The macro whose expansion is cached
+ * @return int The return code
  */
-int _expand(CPreprocessor *const proc, string key, string *expansion) {
-    int ret_code;
-    StringsPair pair;
-    string value_start;
-    string value;
-    string token;
-    string f_exp = calloc(BUFFER_SIZE, 1);
-    string l_exp = calloc(BUFFER_SIZE, 1);
-    string delim = calloc(2, 1);
-    ret_code = proc->map.get(&proc->map, key, &pair);
+int _add_dependent(CPreprocessor *const proc, const Atom *word,
+                   const Atom *macro) {
+    DependentList *list;
+    int ret_code = _dependent_list(proc, word, &list);
 
-    if (ret_code < 0) { return ret_code; }
+    if (ret_code != 0) { return ret_code; }
 
-    /* If this is key exists in the hashmap */
-    if (strcmp(pair.first, key) == 0) {
-        /* Try to expand it too */
-        value = strcpy(calloc(strlen(pair.second) + 1, 1), pair.second);
-        if (value == NULL) {
-            CERR(TRUE, "Couldn't allocate memory");
-            return MALLOC_ERR;
-        }
-        value_start = value;
-
-        token = simple_tok(&value, DELIMS, &delim);
-        while (token) {
-            if (strcmp(token, "") != 0 && strcmp(token, " ") != 0) {
-                memset(l_exp, 0, BUFFER_SIZE);
-                ret_code = _expand(proc, token, &l_exp);
-
-                if (ret_code < 0) {
-                    clear_spair(&pair);
-                    return ret_code;
-                } else if (ret_code == 0) {
-                    concatentate(&f_exp, f_exp, l_exp);
-                    concatentate(&f_exp, f_exp, delim);
-                } else {
-                    concatentate(&f_exp, f_exp, token);
-                }
-            } else {
-                if (strcmp(token, "") == 0) {
-                    concatentate(&f_exp, f_exp, delim);
-                }
-            }
+    /* The words of a body are added together, so a repeated word of the same
+     * macro is always the last one */
+    if (list->count != 0 && list->macros[list->count - 1] == macro) {
+        return 0;
+    }
 
-            token = simple_tok(&value, DELIMS, &delim);
-        }
+    if (list->count == list->capacity) {
+        int new_cap = list->capacity == 0 ? 4 : list->capacity * 2;
+        const Atom **aux_buff =
+            realloc((void *)list->macros, new_cap * sizeof(const Atom *));
 
-        strcpy(*expansion, f_exp);
-        free(value_start);
-    } else {
-        free(delim);
-        free(f_exp);
-        free(l_exp);
-        clear_spair(&pair);
-        return 1;
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the dependents");
+            return MALLOC_ERR;
+        }
+        list->macros = aux_buff;
+        list->capacity = new_cap;
     }
 
-    free(delim);
-    free(f_exp);
-    free(l_exp);
-    clear_spair(&pair);
+    list->macros[list->count++] = macro;
     return 0;
 }
 
 /**
- * @brief Process #define & #undef macros
+ * @brief Record the words a macro body uses. This is done once for every body
+ * of the macro, so the expansions that are not cached don't add them again.
  * @param proc The processor that uses this function
- * @param token The macro name
- * @param rest_of_line The arguments (if they exist)
+ * @param macro The macro
+ * @param body The body of the macro
  * @return int The return code
  */
-int _process_definitions(CPreprocessor *const proc, string token,
-                         string rest_of_line) {
-    int ret_code = 0;
-    if (strncmp(token, "#define", 7) == 0) {
-        ret_code = add_define(proc, rest_of_line);
-    } else if (strncmp(token, "#undef", 6) == 0) {
-        ret_code = proc->map.remove(&proc->map, rest_of_line);
+int _register_dependents(CPreprocessor *const proc, const Atom *macro,
+                         const MacroBody *body) {
+    DependentList *list;
+    int ret_code = _dependent_list(proc, macro, &list);
+    int i;
+
+    if (ret_code != 0 || list->registered == body) { return ret_code; }
+
+    for (i = 0; i < body->count; ++i) {
+        if (body->pieces[i].kind != PIECE_WORD) { continue; }
+
+        ret_code = _add_dependent(proc, body->pieces[i].atom, macro);
+        if (ret_code != 0) { return ret_code; }
     }
 
-    if (ret_code < 0) { return ret_code; }
+    /* The index could have been moved by the new words */
+    proc->dependents[macro->id].registered = body;
     return 0;
 }
 
-int _process_ifs(CPreprocessor *const proc, string token, string rest_of_line,
-                 int *opened_ifs, int **ifs) {
+/**
+ * @brief Drop the cached expansions that depend on a word, because the word
+ * was defined or undefined. The macros whose expansion was dropped are also
+ * invalidated, as other cached expansions could contain them. A cached
+ * expansion only contains cached macros, so the macros that are not cached
+ * are skipped (this also ends the dependency cycles).
+ * @param proc The processor that uses this function
+ * @param word The word that was defined/undefined
+ * @return int The return code
+ */
+int _invalidate_expansions(CPreprocessor *const proc, const Atom *word) {
+    const StringsPair *cached;
+    const Atom *macro;
     int ret_code;
-    int exist;
-    string expansion = calloc(BUFFER_SIZE, 1);
-
-    if (expansion == NULL) {
-        CERR(TRUE, "Couldn't allocate memory");
-        return MALLOC_ERR;
-    }
-
-    exist = is_defined(proc, rest_of_line);
+    int i;
 
-    if (exist < 0) {
-        free(expansion);
-        return exist;
-    }
+    if (word->id >= proc->_c_dependents) { return 0; }
 
-    if (exist == 0) {
-        ret_code = _expand(proc, rest_of_line, &expansion);
-        if (ret_code < 0) {
-            free(expansion);
-            return ret_code;
-        }
-    } else {
-        if (rest_of_line != NULL) {
-            strcpy(expansion, rest_of_line);
-        } else {
-            strcpy(expansion, "0");
+    for (i = 0; i < proc->dependents[word->id].count; ++i) {
+        macro = proc->dependents[word->id].macros[i];
+        if (proc->expansions.find_hashed(&proc->expansions, macro->text,
+                                         macro->hash, &cached) != 0) {
+            continue;
         }
-    }
 
-    if ((strcmp(token, "#if") == 0 && strcmp(expansion, "0") != 0) ||
-        (strcmp(token, "#ifdef") == 0 && exist == 0) ||
-        (strcmp(token, "#ifndef") == 0 && exist != 0)) {
-        /* True */
-        *opened_ifs = *opened_ifs + 1;
-        (*ifs)[*opened_ifs] = TRUE;
-    } else {
-        /* False */
-        *opened_ifs = *opened_ifs + 1;
-        (*ifs)[*opened_ifs] = FALSE;
+        proc->expansions.remove(&proc->expansions, macro->text);
+        ret_code = _invalidate_expansions(proc, macro);
+        if (ret_code < 0) { return ret_code; }
     }
 
-    free(expansion);
     return 0;
 }
 
-int _process_elses(CPreprocessor *const proc, string token, string rest_of_line,
-                   int *opened_ifs, int **ifs) {
-    int ret_code;
-    int exist;
-    string expansion = calloc(BUFFER_SIZE, 1);
-
-    exist = is_defined(proc, rest_of_line);
+int _expand(CPreprocessor *const proc, const Atom *key,
+            StringBuilder *expansion);
 
-    if (exist < 0) {
-        free(expansion);
-        return exist;
+/**
+ * @brief Fully expand the value of a macro, walking over its replacement list,
+ * and cache the result (unless a macro name was kept, as the expansion then
+ * depends on where the macro was used). The nested macros are expanded
+ * directly at the end of the same builder, so nothing is copied twice.
+ * @param proc The processor that uses this function
+ * @param key The macro
+ * @param pair_value The value of the macro
+ * @param expansion The builder the expansion is appended to
+ * @return int The return code (0 for success)
+ */
+int _expand_macro(CPreprocessor *const proc, const Atom *key,
+                  string pair_value, StringBuilder *expansion) {
+    int ret_code;
+    int i;
+    size_t start = expansion->len;
+    StringsPair cached;
+    ExpandFrame frame;
+    const MacroBody *body;
+    const BodyPiece *piece;
+    DependentList *list;
+
+    /* The body is known since the macro was defined (except for the shared
+     * macros, until their first expansion) */
+    body = key->id < proc->_c_dependents ? proc->dependents[key->id].body
+                                         : NULL;
+    if (body == NULL) {
+        ret_code = _macro_body(proc, pair_value, &body);
+        if (ret_code < 0) { return ret_code; }
+        ret_code = _dependent_list(proc, key, &list);
+        if (ret_code < 0) { return ret_code; }
+        list->body = body;
     }
 
-    if (exist == 0) {
-        ret_code = _expand(proc, rest_of_line, &expansion);
-        if (ret_code < 0) {
-            free(expansion);
-            return ret_code;
+    /* The words of the value can also be (un)defined later */
+    ret_code = _register_dependents(proc, key, body);
+
+    frame.macro = key;
+    frame.cut = FALSE;
+    frame.parent = proc->_expanding;
+    proc->_expanding = &frame;
+
+    for (i = 0; i < body->count && ret_code >= 0; ++i) {
+        piece = &body->pieces[i];
+
+        if (piece->kind != PIECE_WORD) {
+            ret_code = expansion->append_span(
+                expansion, body->text + piece->start, piece->len);
+            continue;
         }
-    } else {
-        if (rest_of_line != NULL) {
-            strcpy(expansion, rest_of_line);
-        } else {
-            strcpy(expansion, "0");
+
+        ret_code = _expand(proc, piece->atom, expansion);
+        if (ret_code == 1) {
+            ret_code = expansion->append(expansion, piece->atom->text);
         }
     }
 
-    if (strcmp(token, "#else") == 0) {
-        if ((*ifs)[*opened_ifs] == FALSE) {
-            (*ifs)[*opened_ifs] = TRUE;
-        } else {
-            (*ifs)[*opened_ifs] = FALSE;
+    proc->_expanding = frame.parent;
+    if (ret_code < 0 || frame.cut) { return ret_code < 0 ? ret_code : 0; }
+
+    cached.first = key->text;
+    cached.second = expansion->len == start ? "" : expansion->data + start;
+    return proc->expansions.put(&proc->expansions, cached);
+}
+
+/**
+ * @brief Check if a macro is being expanded. If it is, none of the macros that
+ * are being expanded are cached, as they are part of a cycle (and a cached
+ * expansion could be used inside the cycle, where it must keep the name)
+ * @param proc The processor that uses this function
+ * @param key The macro
+ * @return int TRUE if the macro is being expanded, FALSE otherwise
+ */
+int _is_expanding(CPreprocessor *const proc, const Atom *key) {
+    ExpandFrame *frame;
+
+    for (frame = proc->_expanding; frame != NULL; frame = frame->parent) {
+        if (frame->macro == key) { break; }
+    }
+    if (frame == NULL) { return FALSE; }
+
+    for (frame = proc->_expanding; frame != NULL; frame = frame->parent) {
+        frame->cut = TRUE;
+    }
+    return TRUE;
+}
+
+/**
+ * @brief Try to expand the specified string. If it can't code 1 is returned.
+ * The full expansions of the macros are cached, so they are computed only once
+ * (until one of the words they depend on is defined or undefined). A macro is
+ * not expanded inside its own expansion.
+ * @param proc The processor that uses this function
+ * @param key The (atom of the) key/word to expand
+ * @param expansion The builder the expansion is appended to
+ * @return int The return code (1 for no expansion, 0 for success)
+ */
+int _expand(CPreprocessor *const proc, const Atom *key,
+            StringBuilder *expansion) {
+    const StringsPair *cached;
+    string value;
+    int ret_code;
+#if STATS_MODE
+    size_t start = expansion->len; /* Only the appended bytes are counted */
+#endif
+
+    /* Most of the words are not macros, so check this before anything else */
+    if (_find_macro(proc, key->text, key->hash, &value) != 0) { return 1; }
+    if (_is_expanding(proc, key)) { return 1; }
+
+    STATS_BEGIN(STATS_EXPAND);
+    if (proc->expansions.find_hashed(&proc->expansions, key->text, key->hash,
+                                     &cached) == 0) {
+        ret_code = expansion->append(expansion, cached->second);
+    } else {
+        ret_code = _expand_macro(proc, key, value, expansion);
+    }
+    STATS_END(STATS_EXPAND, ret_code == 0 ? expansion->len - start : 0);
+
+    return ret_code;
+}
+
+/**
+ * @brief Process #define & #undef macros
+ * @param proc The processor that uses this function
+ * @param directive The kind of the directive
+ * @param rest_of_line The arguments (if they exist)
+ * @return int The return code
+ */
+int _process_definitions(CPreprocessor *const proc, int directive,
+                         string rest_of_line) {
+    StringsPair undef;
+    const Atom *atom;
+    string value;
+    int ret_code = 0;
+
+    if (rest_of_line == NULL) {
+        CERR(TRUE, "Missing macro name");
+        return FILE_ERR;
+    }
+
+    if (directive == DIRECTIVE_DEFINE) {
+        /* After this, rest_of_line only contains the macro name */
+        ret_code = add_define(proc, rest_of_line);
+        if (ret_code == 0) {
+            ret_code = proc->undefs.remove(&proc->undefs, rest_of_line);
         }
-    } else if (strcmp(token, "#endif") == 0) {
-        (*ifs)[*opened_ifs] = FALSE;
-        *opened_ifs = *opened_ifs - 1;
-    } else if (strcmp(token, "#elif") == 0) {
-        if ((*ifs)[*opened_ifs] == FALSE && strcmp(expansion, "0") != 0) {
-            (*ifs)[*opened_ifs] = TRUE;
+    } else if (directive == DIRECTIVE_UNDEF) {
+        ret_code = proc->map.remove(&proc->map, rest_of_line);
+
+        /* The shared macros can't be removed, so they are hidden */
+        if (ret_code == 0 &&
+            _find_shared(proc, rest_of_line, hash(rest_of_line), &value) ==
+                0) {
+            undef.first = rest_of_line;
+            undef.second = "";
+            ret_code = proc->undefs.put(&proc->undefs, undef);
+        }
+    }
+
+    if (ret_code < 0) { return ret_code; }
+
+    /* The expansion of the macro, and the cached expansions that used it, are
+     * now stale */
+    ret_code = proc->atoms.intern(&proc->atoms, rest_of_line,
+                                  strlen(rest_of_line), &atom);
+    if (ret_code < 0) { return ret_code; }
+
+    /* An undefined macro has no body */
+    if (directive == DIRECTIVE_UNDEF && atom->id < proc->_c_dependents) {
+        proc->dependents[atom->id].body = NULL;
+    }
+
+    proc->expansions.remove(&proc->expansions, rest_of_line);
+    return _invalidate_expansions(proc, atom);
+}
+
+/**
+ * @brief Find a macro used by an #if expression (see ExprResolve)
+ * @param ctx The processor
+ * @param name The name of the macro
+ * @param value The full expansion of the macro (NULL if it isn't needed)
+ * @return int The return code (0 - defined, 1 - not defined)
+ */
+int _resolve_condition(void *ctx, const Atom *name, string *value) {
+    CPreprocessor *const proc = ctx;
+    StringBuilder expansion = INIT_STRBUF;
+    string found;
+    int ret_code;
+
+    if (value == NULL) {
+        return _find_macro(proc, name->text, name->hash, &found);
+    }
+
+    ret_code = _expand(proc, name, &expansion);
+    if (ret_code == 0) {
+        /* The value is used until the line is processed */
+        *value = proc->arena.alloc(&proc->arena, expansion.len + 1);
+        if (*value == NULL) {
+            ret_code = MALLOC_ERR;
+        } else if (expansion.len == 0) {
+            (*value)[0] = '\0';
         } else {
-            (*ifs)[*opened_ifs] = FALSE;
+            memcpy(*value, expansion.data, expansion.len + 1);
         }
     }
 
-    free(expansion);
+    expansion.clear(&expansion);
+    return ret_code;
+}
+
+/**
+ * @brief Evaluate the condition of an #if/#elif, as an integer constant
+ * expression. The expressions are compiled once, and found again by their
+ * text (so the headers that are included many times don't parse them
+ * again).
+ * @param proc The processor that uses this function
+ * @param condition The condition (NULL if it is missing)
+ * @param result TRUE or FALSE
+ * @return int The return code (FILE_ERR for invalid expressions)
+ */
+int _eval_condition(CPreprocessor *const proc, string condition, int *result) {
+    long value;
+    int ret_code;
+
+    *result = FALSE;
+    if (condition == NULL) {
+        DEBUG_MSG("Missing #if expression");
+        return FILE_ERR;
+    }
+
+    ret_code = proc->conditions.eval(&proc->conditions, &proc->atoms, condition,
+                                     _resolve_condition, proc, &value);
+    if (ret_code < 0) { return ret_code; }
+
+    *result = value != 0;
     return 0;
 }
 
-int _process_includes(CPreprocessor *const proc, string token,
-                      string rest_of_line, FILE **o_fd) {
+/**
+ * @brief Process #if, #ifdef & #ifndef, in an active block. They open a new
+ * group, that starts active or seeking (a block to take).
+ * @param proc The processor that uses this function
+ * @param directive The kind of the directive
+ * @param rest_of_line The condition (if it exists)
+ * @param opened_ifs The index of the innermost group (-1 if there is none)
+ * @param ifs The states of the opened groups
+ * @return int The return code
+ */
+int _process_ifs(CPreprocessor *const proc, int directive, string rest_of_line,
+                 int *opened_ifs, int *ifs) {
+    int ret_code = 0;
+    int taken;
+
+    if (directive == DIRECTIVE_IF) {
+        ret_code = _eval_condition(proc, rest_of_line, &taken);
+    } else {
+        taken = is_defined(proc, rest_of_line);
+        if (taken < 0) { return taken; }
+        taken = (taken == 0) == (directive == DIRECTIVE_IFDEF);
+    }
+    if (ret_code < 0) { return ret_code; }
+
+    if (*opened_ifs + 1 == BUFFER_SIZE) {
+        CERR(TRUE, "Too many nested #if blocks");
+        return FILE_ERR;
+    }
+
+    *opened_ifs = *opened_ifs + 1;
+    ifs[*opened_ifs] = taken ? IF_ACTIVE : IF_SEEKING;
     return 0;
 }
 
 /**
- * @brief Preprocess data from the input file descriptor and
- * write the processed data into the output file descriptor
- * @param i_fd The input file descriptor
- * @param o_fd The output file descriptor
+ * @brief Process #elif, #else & #endif. The condition of an #elif is evaluated
+ * only if no block of the group was taken yet.
+ * @param proc The processor that uses this function
+ * @param directive The kind of the directive
+ * @param rest_of_line The condition (if it exists)
+ * @param opened_ifs The index of the innermost group (-1 if there is none)
+ * @param ifs The states of the opened groups
+ * @return int The return code
+ */
+int _process_elses(CPreprocessor *const proc, int directive,
+                   string rest_of_line, int *opened_ifs, int *ifs) {
+    int ret_code;
+    int taken;
+
+    if (*opened_ifs == -1) {
+        DEBUG_MSG("Conditional directive without #if");
+        return 0;
+    }
+
+    if (directive == DIRECTIVE_ENDIF) {
+        *opened_ifs = *opened_ifs - 1;
+    } else if (ifs[*opened_ifs] != IF_SEEKING) {
+        /* A block was already taken */
+        ifs[*opened_ifs] = IF_DONE;
+    } else if (directive == DIRECTIVE_ELSE) {
+        ifs[*opened_ifs] = IF_ACTIVE;
+    } else {
+        ret_code = _eval_condition(proc, rest_of_line, &taken);
+        if (ret_code < 0) { return ret_code; }
+        if (taken) { ifs[*opened_ifs] = IF_ACTIVE; }
+    }
+
+    return 0;
+}
+
+int process_input(InputReader *const in, string in_path,
+                  OutputWriter *const out, CPreprocessor *const proc);
+
+/**
+ * @brief Process #include directives. The "file" form is searched in the
+ * directory of the current file, then in the include directories; the <file>
+ * form only in the include directories. Headers that are guarded (by a
+ * "#ifndef" block around all their content, or by "#pragma once") are skipped
+ * when they were already included.
+ * @param proc The processor that uses this function
+ * @param in_path The path of the current file (NULL for stdin)
+ * @param rest_of_line The arguments of the directive
+ * @param out The output writer
+ * @return int The return code
+ */
+int _process_includes(CPreprocessor *const proc, string in_path,
+                      string rest_of_line, OutputWriter *const out) {
+    InputReader view;
+    Header *header;
+    const char *path;
+    const char *slash = NULL;
+    string name;
+    string end;
+    char closing;
+    int ret_code;
+
+    if (rest_of_line == NULL) {
+        CERR(TRUE, "Missing include file name");
+        return FILE_ERR;
+    }
+
+    /* Extract the name, between "" or <> */
+    name = rest_of_line;
+    while (*name == ' ' || *name == '\t') { name++; }
+    closing = *name == '"' ? '"' : (*name == '<' ? '>' : '\0');
+    end = closing != '\0' ? strchr(name + 1, closing) : NULL;
+    if (end == NULL) {
+        CERR(TRUE, "Invalid include directive");
+        return FILE_ERR;
+    }
+    *end = '\0';
+    name++;
+
+    /* Search the file, then read it (if it wasn't read before) */
+    if (in_path != NULL) { slash = strrchr(in_path, '/'); }
+    ret_code = proc->resolver.resolve(
+        &proc->resolver, slash != NULL ? in_path : NULL,
+        slash != NULL ? (size_t)(slash - in_path) : 0, name, closing == '"',
+        &path);
+    if (ret_code == 0) {
+        ret_code = proc->headers.load(&proc->headers, (string)path, &header);
+    }
+
+    if (ret_code == 1) {
+        DEBUG_MSG("Couldn't find the included file");
+        return FILE_ERR;
+    }
+    if (ret_code != 0) { return ret_code; }
+
+    /* Guarded headers that were already processed produce nothing */
+    if (header->included && header->once) { return 0; }
+    if (header->guard != NULL && is_defined(proc, header->guard) == 0) {
+        return 0;
+    }
+
+    if (proc->_include_depth == INCLUDE_DEPTH_MAX) {
+        CERR(TRUE, "Too many nested includes");
+        return FILE_ERR;
+    }
+
+    /* The content is read from the cache, through a separate view, so the
+     * same header can be processed again (or recursively) */
+    header->included = TRUE;
+    header->content.view(&header->content, &view);
+
+    proc->_include_depth++;
+    ret_code = process_input(&view, header->path, out, proc);
+    proc->_include_depth--;
+
+    view.close(&view);
+    return ret_code;
+}
+
+/**
+ * @brief Preprocess data from the input reader and write the processed data
+ * into the output writer
+ * @param in The input reader
+ * @param in_path The path of the input (NULL for stdin)
+ * @param out The output writer
  * @param proc The preprocessor "object"
  * @return int the return code
  */
-int process_input(FILE *i_fd, FILE **o_fd, CPreprocessor *const proc) {
-    string buffer;       /* Original read line */
-    string line;         /* The "tokenizeable" line */
-    string rest_of_line; /* Pointer to the rest of the line (after a token) */
-    string unprocessed_pointer; /* Pointer used to write unprocessed data */
-    string token;               /* Pointer to the extracted tokens */
-    string processed_pointer;   /* Pointer used to write unprocessed data */
-    string before; /* Pointer for unprocessed data that needs to be written */
-    string expansion; /* Pointer used to store the expansion of a token */
-    int ret_code, read_code, offset;
+int process_input(InputReader *const in, string in_path,
+                  OutputWriter *const out, CPreprocessor *const proc) {
+    string args;         /* The arguments of a directive */
+    StringBuilder expansion = INIT_STRBUF; /* The expansion of a token */
+    const Atom *atom;    /* The interned token */
+    const char *span;    /* The line, as it is stored by the reader */
+    size_t span_len;
+    Directive directive;
+    Lexer lexer = INIT_LEXER;
+    Token token;
+    int ret_code, read_code;
     int *ifs;
     int opened_ifs = -1;
+    int active;         /* The lines are not inside a "false" block */
+    int skip_depth = 0; /* The #if blocks opened inside an inactive region */
 
     /* Init memory for buffers/arrays */
-    ret_code = _allocate_process_data(&buffer, &line, &expansion, &ifs);
+    ret_code = _allocate_process_data(&ifs);
     if (ret_code != 0) { return ret_code; }
 
-    memset(ifs, FALSE, BUFFER_SIZE * sizeof(int));
-
     /* Read lines 1 by 1 */
-    read_code = read_line(&buffer, i_fd);
+    read_code = in->next_line(in, &span, &span_len);
     while (read_code == 1) {
-        strcpy(line, buffer);
-        unprocessed_pointer = buffer;
-
-        /* To make sure there are no spaces before a #[directive], we must
-         * extract a token. However, we can't tokenize the line, as it will
-         * alter it. For this reason, I used the expansion array, which will be
-         * anyway cleaned before use */
-        strcpy(expansion, buffer);
+        ret_code = 0;
+        active = opened_ifs == -1 || ifs[opened_ifs] == IF_ACTIVE;
 
-        token = strtok(expansion, " ");
         /* Check if the line starts with a preprocessor directive. This
-         * assumes that there are no characters before a directive. */
-        if (token[0] == '#') {
-            /* Lines with directives on them */
-            token = strtok(line, " \n");
-            rest_of_line = strtok(NULL, "\n");
-
-            ret_code = 0;
-            if (token[1] == 'e') {
+         * assumes that there are no characters (except spaces) before a
+         * directive. */
+        lexer_directive(span, span_len, &directive);
+
+        if (!active && (skip_depth != 0 || IS_IF_DIRECTIVE(directive.kind))) {
+            /* The blocks nested in an inactive region are only counted, so
+             * their #else/#endif are matched correctly */
+            if (IS_IF_DIRECTIVE(directive.kind)) {
+                skip_depth++;
+            } else if (directive.kind == DIRECTIVE_ENDIF) {
+                skip_depth--;
+            }
+        } else if (directive.kind != DIRECTIVE_NONE) {
+            /* Only the arguments are copied, as the handlers need them
+             * null-terminated (and some of them tokenize them in place).
+             * #else and #endif don't use them, and the other directives of
+             * an inactive block are ignored. */
+            args = NULL;
+            if (directive.args_len != 0 && directive.kind != DIRECTIVE_ELSE &&
+                directive.kind != DIRECTIVE_ENDIF &&
+                (active || directive.kind == DIRECTIVE_ELIF)) {
+                args = proc->arena.alloc(&proc->arena, directive.args_len + 1);
+                if (args == NULL) {
+                    read_code = MALLOC_ERR;
+                    break;
+                }
+                memcpy(args, span + directive.args, directive.args_len);
+                args[directive.args_len] = '\0';
+            }
+
+            if (directive.kind >= DIRECTIVE_ELIF) {
                 /* else, elif, endif. These terminate blocks. */
-                ret_code = _process_elses(proc, token, rest_of_line,
-                                          &opened_ifs, &ifs);
-            } else if (opened_ifs == -1 || ifs[opened_ifs] == TRUE) {
+                ret_code = _process_elses(proc, directive.kind, args,
+                                          &opened_ifs, ifs);
+            } else if (active) {
                 /* Everything here can be inside a block, so we must check the
                  * "if state" */
-
-                if (strcmp(token, "#include") == 0) {
-                    /* include is a special case of macro starting with 'i' */
-                    ret_code =
-                        _process_includes(proc, token, rest_of_line, o_fd);
-                } else {
-                    if (token[1] == 'd' || token[1] == 'u') {
-                        /* define or undefine */
+                switch (directive.kind) {
+                    case DIRECTIVE_INCLUDE:
+                        ret_code = _process_includes(proc, in_path, args, out);
+                        break;
+                    case DIRECTIVE_DEFINE:
+                    case DIRECTIVE_UNDEF:
                         ret_code =
-                            _process_definitions(proc, token, rest_of_line);
-                    } else if (token[1] == 'i') {
-                        /* if, ifndef, ifdef */
-                        ret_code = _process_ifs(proc, token, rest_of_line,
-                                                &opened_ifs, &ifs);
-                    }
+                            _process_definitions(proc, directive.kind, args);
+                        break;
+                    case DIRECTIVE_IF:
+                    case DIRECTIVE_IFDEF:
+                    case DIRECTIVE_IFNDEF:
+                        ret_code = _process_ifs(proc, directive.kind, args,
+                                                &opened_ifs, ifs);
+                        break;
+                    default:
+                        /* The other directives are ignored */
+                        break;
                 }
             }
+        } else if (active) {
+            /* Normal lines, without any directives (ignored if the #if...
+             * macro was "false"). The line is walked once: the delimiters
+             * and the words that can't be macros are written directly from
+             * the read line, the identifiers are interned (so they are
+             * hashed only once) and expanded. */
+            lexer_start(&lexer, span, span_len);
+            while (ret_code >= 0 && lexer_next(&lexer, &token)) {
+                if (token.kind != TOKEN_IDENT) {
+                    ret_code = out->write(out, span + token.start, token.len);
+                    continue;
+                }
 
-            if (ret_code < 0) {
-                _free_process_data(&buffer, &line, &expansion, &ifs);
-                return ret_code;
-            }
-        } else {
-            /* Normal lines, without any directives */
-            /* Ignored if the #if... macro was "false" */
-            if (opened_ifs == -1 || ifs[opened_ifs] == TRUE) {
-                /* Tokenize line to get words that could be macros
-                 */
-                token = strtok(line, DELIMS);
-                while (token) {
-                    /* Check if there are chars before the current
-                     * token that weren't written to the output */
-                    processed_pointer = strstr(unprocessed_pointer, token);
-                    offset = processed_pointer - unprocessed_pointer;
-
-                    /* If there is unprocessed that needs to be
-                     * written*/
-                    if (offset) {
-                        before = strncpy(calloc(offset + 1, 1),
-                                         unprocessed_pointer, offset);
-
-                        if (before == NULL) {
-                            CERR(TRUE, "Couldn't allocate memory");
-                            _free_process_data(&buffer, &line, &expansion,
-                                               &ifs);
-                            return MALLOC_ERR;
-                        }
-
-                        unprocessed_pointer = processed_pointer;
-                        fwrite(before, sizeof(char), strlen(before), *o_fd);
-                        free(before);
-                    }
-
-                    /* Check if the token is a macro to be expanded
-                     */
-                    ret_code = _expand(proc, token, &expansion);
-
-                    if (ret_code < 0) {
-                        _free_process_data(&buffer, &line, &expansion, &ifs);
-                        return ret_code;
-                    }
-
-                    if (ret_code == 0) {
-                        fwrite(expansion, sizeof(char), strlen(expansion),
-                               *o_fd);
-                    } else {
-                        /* Not a macro */
-                        fwrite(token, sizeof(char), strlen(token), *o_fd);
-                    }
-
-                    memset(expansion, 0, BUFFER_SIZE);
-                    unprocessed_pointer += strlen(token);
-
-                    token = strtok(NULL, DELIMS);
+                ret_code = proc->atoms.intern(&proc->atoms, span + token.start,
+                                              token.len, &atom);
+                if (ret_code >= 0) {
+                    expansion.reset(&expansion);
+                    ret_code = _expand(proc, atom, &expansion);
                 }
 
-                /* Check if it was EOF (in some cases, the file can
-                 * end without newline, which can lead to some
-                 * problems) */
-                if (buffer[strlen(buffer) - 1] != '\n') {
-                    /* As the newline character can be a token, no
-                     * line (except the last one) can have
-                     * unprocessed data after the tokenization. */
-                    fwrite(unprocessed_pointer, sizeof(char),
-                           strlen(unprocessed_pointer), *o_fd);
+                if (ret_code == 0 && expansion.len != 0) {
+                    ret_code = out->write(out, expansion.data, expansion.len);
+                } else if (ret_code == 1) {
+                    /* Not a macro */
+                    ret_code = out->write(out, span + token.start, token.len);
                 }
             }
         }
 
+        if (ret_code < 0) {
+            read_code = ret_code;
+            break;
+        }
+
+        /* The scratch memory used by the line is not needed anymore */
+        proc->arena.reset(&proc->arena);
+
+        /* In an inactive region only the directives matter, so the other
+         * lines are skipped without being read */
+        if (opened_ifs != -1 && ifs[opened_ifs] != IF_ACTIVE) {
+            in->skip_to_directive(in);
+        }
+
         /* Read next line */
-        read_code = read_line(&buffer, i_fd);
+        read_code = in->next_line(in, &span, &span_len);
     }
 
-    _free_process_data(&buffer, &line, &expansion, &ifs);
+    _free_process_data(&expansion, &ifs);
 
     if (read_code < 0) { return read_code; }
     return 0;
 }
 
+/**
+ * @brief Set the dependency output, from a -M... argument. -MF alone also
+ * enables the rule, next to the output.
+ * @param this The processor
+ * @param option The option
+ * @param value The value of the option (NULL for -M and -MD)
+ * @return int The return code (FILE_ERR for unknown options)
+ */
+int _set_deps(CPreprocessor *const this, string option, string value) {
+    if (strcmp(option, "-M") == 0) {
+        this->deps = DEPS_ONLY;
+    } else if (strcmp(option, "-MD") == 0) {
+        this->deps = DEPS_FILE;
+    } else if (value != NULL && option[2] == 'T') {
+        return _set_string(&this->dep_target, value);
+    } else if (value != NULL && option[2] == 'F') {
+        if (this->deps == DEPS_NONE) { this->deps = DEPS_FILE; }
+        return _set_string(&this->dep_file, value);
+    } else {
+        CERR(TRUE, "Unknown dependency option");
+        return FILE_ERR;
+    }
+
+    return 0;
+}
+
+/* The options that are followed by a value (in the same argument, or in the
+ * next one). -MF and -MT are checked before the options without values that
+ * start like them (-M, -MD). */
+const char *const _value_options[] = {"-MF", "-MT", "-D", "-I", "-o", "-B",
+                                      "-j",  "-P",  "-W", "-S", "-C"};
+
+int cpreprocessor_option(int argc, string argv[], int *i, string *value) {
+    size_t count = sizeof(_value_options) / sizeof(_value_options[0]);
+    size_t len;
+    size_t j;
+
+    *value = NULL;
+    for (j = 0; j < count; ++j) {
+        len = strlen(_value_options[j]);
+        if (strncmp(argv[*i], _value_options[j], len) != 0) { continue; }
+
+        if (argv[*i][len] != '\0') {
+            *value = argv[*i] + len;
+        } else if (*i + 1 < argc) {
+            *value = argv[++(*i)];
+        } else {
+            CERR(TRUE, "The option needs a value");
+            return FILE_ERR;
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
 /**
  * @brief Parse the command line arguments
  * @param proc The preprocessor
@@ -788,34 +1255,81 @@ int parse_arguments(CPreprocessor *const proc, int argc, string argv[]) {
     int ret_code = 0;
     int i;
     int i_specified = 0;
+    int positional = 0;
 
     for (i = 1; i < argc; ++i) {
         if (argv[i][0] == '-') {
-            switch (argv[i][1]) {
+            string option = argv[i];
+            string value;
+
+            ret_code = cpreprocessor_option(argc, argv, &i, &value);
+            if (ret_code < 0) {
+                proc->clear(proc);
+                return ret_code;
+            }
+
+            switch (option[1]) {
                 case 'D': {
                     /* Add the defines */
-                    ret_code = add_define(
-                        proc, strlen(argv[i]) == 2 ? argv[++i] : argv[i] + 2);
+                    ret_code = add_define_arg(proc, value);
                 } break;
                 case 'I': {
                     /* Set include directories */
-                    ret_code = add_include(
-                        proc, strlen(argv[i]) == 2 ? argv[++i] : argv[i] + 2);
+                    ret_code = add_include(proc, value);
                 } break;
                 case 'o': {
                     /* Set the output file */
-                    ret_code = set_output(
-                        proc, strlen(argv[i]) == 2 ? argv[++i] : argv[i] + 2);
+                    ret_code = set_output(proc, value);
+                } break;
+                case 'B': {
+                    /* Set the output directory of the batch mode */
+                    ret_code = set_outdir(proc, value);
+                } break;
+                case 'j': {
+                    /* Set the number of workers of the batch mode */
+                    ret_code = set_jobs(proc, value);
+                } break;
+                case 'P': {
+                    /* Load the macros from a snapshot */
+                    ret_code = load_snapshot(proc, value);
+                } break;
+                case 'W': {
+                    /* Save the macros into a snapshot, after the input */
+                    ret_code = _set_string(&proc->snapshot_out, value);
+                } break;
+                case '-': {
+                    /* Print the statistics of the run (--stats[=json]) */
+                    if (strcmp(option, "--stats") == 0) {
+                        stats_enable(FALSE);
+                    } else if (strcmp(option, "--stats=json") == 0) {
+                        stats_enable(TRUE);
+                    }
+                } break;
+                case 'M': {
+                    /* The dependency output (-M, -MD, -MF file, -MT target) */
+                    ret_code = _set_deps(proc, option, value);
+                } break;
+                case 'S':
+                case 'C': {
+                    /* Run as the server, or as a client of the server */
+                    proc->_serve = option[1] == 'S';
+                    ret_code = set_socket(proc, value);
                 } break;
             }
+        } else if (argv[i][0] == '@') {
+            /* A response file, with the inputs of the batch mode */
+            ret_code = add_inputs_file(proc, argv[i] + 1);
         } else {
             /* A argument with no '-' before it. The first one
              * will be the
-             * input, the second will be the output */
-            if (i_specified == FALSE) {
+             * input, the second will be the output. All of them are inputs
+             * in the batch mode */
+            ++positional;
+            ret_code = add_input(proc, argv[i]);
+            if (ret_code == 0 && i_specified == FALSE) {
                 ret_code = set_input(proc, argv[i]);
                 if (ret_code == 0) { i_specified = TRUE; }
-            } else {
+            } else if (ret_code == 0) {
                 ret_code = set_output(proc, argv[i]);
             }
         }
@@ -829,6 +1343,13 @@ int parse_arguments(CPreprocessor *const proc, int argc, string argv[]) {
         }
     }
 
+    /* Without an output directory, only an input and an output can be given */
+    if (positional > 2 && proc->outdir == NULL) {
+        CERR(TRUE, "Too many files (use -B for the batch mode)");
+        proc->clear(proc);
+        return FILE_ERR;
+    }
+
     return ret_code;
 }
 
@@ -836,8 +1357,29 @@ int cpreprocessor_clear(CPreprocessor *const this) {
     int i;
     int ret_code = 0;
     ret_code = this->map.clear(&this->map);
+    this->undefs.clear(&this->undefs);
+    if (this->_base == NULL && this->snapshot != NULL) {
+        this->snapshot->clear(this->snapshot);
+        free(this->snapshot);
+    }
+    this->atoms.clear(&this->atoms);
+    this->conditions.clear(&this->conditions);
+    this->bodies.clear(&this->bodies);
+    this->arena.clear(&this->arena);
+    this->expansions.clear(&this->expansions);
+    _clear_dependents(this);
+    this->headers.clear(&this->headers);
+    this->resolver.clear(&this->resolver);
     free(this->input);
     free(this->output);
+    free(this->outdir);
+    free(this->socket);
+    free(this->snapshot_out);
+    free(this->dep_file);
+    free(this->dep_target);
+
+    for (i = 0; i < this->_c_inputs; ++i) { free(this->inputs[i]); }
+    free(this->inputs);
 
     for (i = 0; i < this->_c_includes; ++i) { free(this->includes[i]); }
     free(this->includes);
@@ -845,18 +1387,124 @@ int cpreprocessor_clear(CPreprocessor *const this) {
     return ret_code;
 }
 
-int cpreprocessor_init(CPreprocessor *const this, int argc, string argv[]) {
+/**
+ * @brief Set the initial state of a preprocessor (without any allocations)
+ * @param this The preprocessor
+ */
+void _init_state(CPreprocessor *const this) {
     Hashmap new_map = INIT_HASHMAP;
+    Arena new_arena = INIT_ARENA;
+    AtomTable new_atoms = INIT_ATOMTABLE;
+    ExprCache new_conditions = INIT_EXPRCACHE;
+    BodyCache new_bodies = INIT_BODYCACHE;
+    HeaderCache new_headers = INIT_HEADERCACHE;
+    IncludeResolver new_resolver = INIT_RESOLVER;
+
+    this->_c_includes = 0;
+    this->_c_inputs = 0;
+    this->_include_depth = 0;
+    this->jobs = 0;
+    this->socket = NULL;
+    this->_serve = FALSE;
+    this->deps = DEPS_NONE;
+    this->dep_file = NULL;
+    this->dep_target = NULL;
+    this->snapshot = NULL;
+    this->snapshot_out = NULL;
+    this->_argc = 0;
+    this->_argv = NULL;
+    this->input = NULL;
+    this->output = NULL;
+    this->outdir = NULL;
+    this->inputs = NULL;
+    this->includes = NULL;
+    this->map = new_map;
+    this->_base = NULL;
+    this->undefs = new_map;
+    this->arena = new_arena;
+    this->atoms = new_atoms;
+    this->conditions = new_conditions;
+    this->bodies = new_bodies;
+    this->_expanding = NULL;
+    this->expansions = new_map;
+    this->dependents = NULL;
+    this->_c_dependents = 0;
+    this->headers = new_headers;
+    this->resolver = new_resolver;
+    this->_in_set = FALSE;
+    this->_out_set = FALSE;
+    this->init = cpreprocessor_init;
+    this->start = cpreprocessor_start;
+    this->clear = cpreprocessor_clear;
+}
+
+/* The hashing function is selected once, by the first initialised processor
+ * (the ones created later, by the server, must use the same hashes) */
+int _hash_selected = FALSE;
+
+/**
+ * @brief Select the hashing function and its seed (--hash=<name>,
+ * --hash-seed=<n>). Without a seed, the one of the snapshot loaded with -P is
+ * used (with its function, if no other one was chosen), so its hashes are
+ * used directly; otherwise, a random one is used. This is done before the
+ * other arguments, as the defines are hashed while they are parsed.
+ * @param argc The arguments count
+ * @param argv The arguments vector
+ */
+void _select_hash(int argc, string argv[]) {
+    string name = NULL;
+    string snapshot = NULL;
+    string value;
+    unsigned long seed = 0;
+    int seeded = FALSE;
+    int snapshot_id;
+    int i;
+
+    if (_hash_selected) { return; }
+    _hash_selected = TRUE;
+
+    for (i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--hash=", 7) == 0) {
+            name = argv[i] + 7;
+        } else if (strncmp(argv[i], "--hash-seed=", 12) == 0) {
+            seed = strtoul(argv[i] + 12, NULL, 0);
+            seeded = TRUE;
+        } else if (argv[i][0] == '-') {
+            string option = argv[i];
+
+            /* The values of the options are skipped (the last -P is used) */
+            if (cpreprocessor_option(argc, argv, &i, &value) < 0) { break; }
+            if (option[1] == 'P') { snapshot = value; }
+        }
+    }
+
+    if (!seeded && snapshot != NULL &&
+        snapshot_hash(snapshot, &snapshot_id, &seed) == 0 &&
+        (name == NULL || strcmp(name, hash_name(snapshot_id)) == 0)) {
+        name = (string)hash_name(snapshot_id);
+        seeded = TRUE;
+    }
+
+    if (!seeded) { seed = hash_random_seed(); }
+    if (hash_use(name, seed) != 0) {
+        DEBUG_MSG("Unknown hashing function, the default one is used");
+        hash_use(NULL, seed);
+    }
+}
+
+int cpreprocessor_init(CPreprocessor *const this, int argc, string argv[]) {
     int ret_code = 0;
 
+    scanner_init(DELIMS);
+    _select_hash(argc, argv);
+
     /* Allocate all the memory */
-    this->_c_includes = 0;
+    _init_state(this);
+    this->_argc = argc;
+    this->_argv = argv;
     this->input = calloc(1, sizeof(char));
     this->output = calloc(1, sizeof(char));
-    this->map = new_map;
     this->includes = calloc(1, sizeof(string));
-    this->_in_set = FALSE;
-    this->_out_set = FALSE;
 
     /* Check allocated pointers */
     if (this->input == NULL || this->output == NULL || this->includes == NULL) {
@@ -867,9 +1515,15 @@ int cpreprocessor_init(CPreprocessor *const this, int argc, string argv[]) {
         return MALLOC_ERR;
     }
 
-    /* Check map initialization */
+    /* Check maps initialization */
     ret_code = this->map.init(&this->map);
+    if (ret_code == 0) { ret_code = this->undefs.init(&this->undefs); }
+    if (ret_code == 0) { ret_code = this->expansions.init(&this->expansions); }
+    if (ret_code == 0) { ret_code = this->atoms.init(&this->atoms); }
     if (ret_code != 0) {
+        this->map.clear(&this->map);
+        this->undefs.clear(&this->undefs);
+        this->expansions.clear(&this->expansions);
         free(this->input);
         free(this->output);
         free(this->includes);
@@ -878,41 +1532,204 @@ int cpreprocessor_init(CPreprocessor *const this, int argc, string argv[]) {
 
     /* Parse the arguments */
     ret_code = parse_arguments(this, argc, argv);
+    if (ret_code < 0) { return ret_code; }
+
+    /* The include directories are known only after the arguments */
+    ret_code = this->resolver.init(&this->resolver, this->includes,
+                                   this->_c_includes);
+    if (ret_code != 0) {
+        this->clear(this);
+        return ret_code;
+    }
+
+    return 0;
+}
+
+int cpreprocessor_init_worker(CPreprocessor *const this,
+                              CPreprocessor *const base) {
+    int ret_code;
 
+    _init_state(this);
+    this->_base = &base->map;
+    this->snapshot = base->snapshot;
+
+    ret_code = this->map.init(&this->map);
+    if (ret_code == 0) { ret_code = this->undefs.init(&this->undefs); }
+    if (ret_code == 0) { ret_code = this->expansions.init(&this->expansions); }
+    if (ret_code == 0) { ret_code = this->atoms.init(&this->atoms); }
+    if (ret_code == 0) {
+        /* The include directories belong to the base preprocessor */
+        ret_code = this->resolver.init(&this->resolver, base->includes,
+                                       base->_c_includes);
+    }
+
+    /* Every input gets its own rule, next to its output (so -MF is not
+     * used) */
+    this->deps = base->deps;
+    if (ret_code == 0 && base->dep_target != NULL) {
+        ret_code = _set_string(&this->dep_target, base->dep_target);
+    }
+
+    if (ret_code != 0) {
+        this->clear(this);
+        return ret_code;
+    }
+    return 0;
+}
+
+/**
+ * @brief Forget the macros defined by the previous input of a batch worker
+ * (the cached headers and include paths are kept). The words and the parsed
+ * bodies and conditions are kept too, until there are too many of them
+ * @param this The worker
+ * @return int The return code
+ */
+int _reset_worker(CPreprocessor *const this) {
+    int ret_code = 0;
+
+    this->map.clear(&this->map);
+    this->undefs.clear(&this->undefs);
+    this->expansions.clear(&this->expansions);
+    _clear_dependents(this);
+    this->headers.reset(&this->headers);
+
+    /* The caches use the atoms, so they are dropped with them */
+    if (this->atoms._size > WORKER_ATOMS_MAX ||
+        this->bodies._texts._size > WORKER_ATOMS_MAX ||
+        this->conditions._texts._size > WORKER_ATOMS_MAX) {
+        this->conditions.clear(&this->conditions);
+        this->bodies.clear(&this->bodies);
+        this->atoms.clear(&this->atoms);
+        ret_code = this->atoms.init(&this->atoms);
+    }
+
+    if (ret_code == 0) { ret_code = this->map.init(&this->map); }
+    if (ret_code == 0) { ret_code = this->undefs.init(&this->undefs); }
+    if (ret_code == 0) { ret_code = this->expansions.init(&this->expansions); }
     return ret_code;
 }
 
-int cpreprocessor_start(CPreprocessor *const this) {
-    int i;
+int cpreprocessor_process_files(CPreprocessor *const this, FILE *i_fd,
+                                string in_path, FILE *o_fd) {
     int ret_code;
-    FILE *input, *output;
+    OutputWriter writer = INIT_WRITER;
+    InputReader reader = INIT_READER;
 
-    if (this->_in_set == TRUE) {
-        ret_code = open_input(this->input, &input, this);
-        if (ret_code != 0) {
-            this->clear(this);
-            return ret_code;
-        }
+    if (this->_base != NULL) {
+        ret_code = _reset_worker(this);
+        if (ret_code != 0) { return ret_code; }
+    }
+
+    ret_code = writer.open(&writer, o_fd);
+    if (ret_code == 0) { ret_code = reader.open(&reader, i_fd); }
+    if (ret_code == 0) {
+        ret_code = process_input(&reader, in_path, &writer, this);
+    }
+    if (writer.close(&writer) != 0 && ret_code == 0) { ret_code = IO_ERR; }
+    reader.close(&reader);
+
+    return ret_code;
+}
+
+int cpreprocessor_process(CPreprocessor *const this, string input,
+                          string output) {
+    int ret_code;
+    FILE *i_fd, *o_fd;
+
+    /* The included files are recorded for the dependency rule */
+    if (this->deps != DEPS_NONE) {
+        ret_code = this->resolver.record(&this->resolver);
+        if (ret_code != 0) { return ret_code; }
+    }
+
+    if (input != NULL) {
+        ret_code = open_input(input, &i_fd);
+        if (ret_code != 0) { return ret_code; }
     } else {
-        input = stdin;
+        i_fd = stdin;
     }
 
-    if (this->_out_set == TRUE) {
-        output = fopen(this->output, "w");
-        if (output == NULL) {
-            this->clear(this);
-            close_file(input);
+    if (this->deps == DEPS_ONLY) {
+        /* Only the rule is written, the output is discarded */
+        o_fd = NULL;
+    } else if (output != NULL) {
+        o_fd = fopen(output, "w");
+        if (o_fd == NULL) {
+            close_file(i_fd);
             CERR(TRUE, "Couldn't open file");
             return 1;
         }
     } else {
-        output = stdout;
+        o_fd = stdout;
     }
 
-    process_input(input, &output, this);
-    close_file(input);
-    close_file(output);
+    ret_code = cpreprocessor_process_files(this, i_fd, input, o_fd);
+
+    close_file(i_fd);
+    if (o_fd != NULL) { close_file(o_fd); }
+
+    if (ret_code == 0 && this->deps != DEPS_NONE) {
+        ret_code = deps_write(this, input, output);
+    }
+    return ret_code;
+}
+
+/**
+ * @brief Print the statistics of the run (if they were requested)
+ * @param this The preprocessor
+ * @return int The return code
+ */
+int _print_stats(CPreprocessor *const this) {
+    StatsTable tables[STATS_TABLES_MAX];
+    int count = 0;
+
+    if (!STATS_MODE || !stats.enabled) { return 0; }
+
+    stats_table(&tables[count++], "macros", &this->map);
+    stats_table(&tables[count++], "undefs", &this->undefs);
+    stats_table(&tables[count++], "expansions", &this->expansions);
+    stats_table(&tables[count++], "includes", &this->resolver._cache);
+    return stats_print(tables, count);
+}
+
+/**
+ * @brief Run the command line in this process: the batch mode, or a single
+ * input (and save the snapshot)
+ * @param this The preprocessor
+ * @return int The return code
+ */
+int _start_local(CPreprocessor *const this) {
+    int ret_code;
+
+    if (this->outdir != NULL) { return batch_run(this); }
+
+    ret_code = cpreprocessor_process(this, this->_in_set ? this->input : NULL,
+                                     this->_out_set ? this->output : NULL);
+    if (ret_code == 0 && this->snapshot_out != NULL) {
+        ret_code = save_snapshot(this, this->snapshot_out);
+    }
+    return ret_code;
+}
+
+int cpreprocessor_start(CPreprocessor *const this) {
+    int forwarded = FALSE;
+    int ret_code = 0;
+
+    if (this->socket != NULL && this->_serve) {
+        ret_code = server_run(this);
+    } else {
+        /* The server preprocesses only single inputs: the batch mode, the
+         * dependency output and the snapshot saves are always run here, as
+         * are the requests that find no server */
+        if (this->socket != NULL && this->outdir == NULL &&
+            this->deps == DEPS_NONE && this->snapshot_out == NULL) {
+            ret_code = server_forward(this, &forwarded);
+        }
+        if (!forwarded) { ret_code = _start_local(this); }
+    }
+
+    if (ret_code == 0) { ret_code = _print_stats(this); }
 
     this->clear(this);
-    return 0;
+    return ret_code;
 }
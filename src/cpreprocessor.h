@@ -8,17 +8,92 @@
 #ifndef CPREPROCESSOR_H
 #define CPREPROCESSOR_H
 
+#include "arena.h"
+#include "atoms.h"
+#include "bodies.h"
+#include "expr.h"
 #include "hashmap.h"
+#include "headers.h"
+#include "lexer.h"
+#include "reader.h"
+#include "resolver.h"
+#include "scanner.h"
+#include "snapshot.h"
+#include "strbuf.h"
+#include "writer.h"
 
 #define DELIMS "\t []{}<>=+-*/%!&|^.,:;()\\"
 #define BUFFER_SIZE 256
+#define INCLUDE_DEPTH_MAX 200 /* The maximum nesting of the included files */
+#define WORKER_ATOMS_MAX 65536 /* The words (or texts) a worker keeps cached */
+
+/* The states of an #if group (the blocks up to its #endif) */
+#define IF_ACTIVE 0  /* The current block is emitted */
+#define IF_SEEKING 1 /* No block was taken yet, a later #elif/#else can be */
+#define IF_DONE 2    /* A block was taken, the rest of the group is skipped */
+
+/* The dependency output (the included files, as a make rule) */
+#define DEPS_NONE 0 /* No rule is written */
+#define DEPS_ONLY 1 /* -M: the rule is written instead of the output */
+#define DEPS_FILE 2 /* -MD: the rule is written in a file, with the output */
+
+/**
+ * @brief A macro that is being expanded. A macro is not expanded again inside
+ * its own expansion (its name is kept as it is).
+ */
+typedef struct ExpandFrame {
+    const Atom *macro;
+    int cut; /* A macro name was kept in the expansion (it is not cached) */
+    struct ExpandFrame *parent;
+} ExpandFrame;
+
+/**
+ * @brief The macros whose expansions used a word. If the word is defined or
+ * undefined, their cached expansions are dropped. The body of the word (as a
+ * macro) is also kept here, so it is not searched again by its text.
+ */
+typedef struct DependentList {
+    const Atom **macros;
+    int count;
+    int capacity;
+    const MacroBody *body;       /* The body of the current definition of the
+                                  * word (NULL if it is not known yet) */
+    const MacroBody *registered; /* The body of the word (as a macro), whose
+                                  * words already point to it */
+} DependentList;
 
 typedef struct CPreprocessor {
     Hashmap map;
+    Hashmap *_base;      /* Shared command line macros (batch workers only) */
+    Hashmap undefs;      /* The shared macros that were undefined */
+    Hashmap expansions;  /* Cached full expansions of the macros */
+    DependentList *dependents; /* Indexed by the ids of the words' atoms */
+    int _c_dependents;
+    Arena arena;         /* Scratch memory, released after every line */
+    AtomTable atoms;     /* The interned words */
+    ExprCache conditions; /* The compiled #if/#elif expressions */
+    BodyCache bodies;     /* The pre-parsed macro bodies */
+    ExpandFrame *_expanding; /* The innermost macro that is being expanded */
+    HeaderCache headers; /* The headers that were read */
+    IncludeResolver resolver;
     string input;
     string output;
+    string outdir;  /* The output directory (NULL if not in batch mode) */
+    string *inputs; /* All the inputs, used by the batch mode */
+    int _c_inputs;
+    int jobs; /* The number of workers (0 for one for every core) */
+    Snapshot *snapshot;  /* The loaded macros snapshot (NULL if not used) */
+    string snapshot_out; /* Where the macros are saved (NULL if not saved) */
+    string socket; /* The socket of the server (NULL if not used) */
+    int deps;          /* The dependency output (DEPS_...) */
+    string dep_file;   /* The file of the rule (NULL for the default one) */
+    string dep_target; /* The target of the rule (NULL for the default one) */
+    int _serve;    /* Run as the server, not as its client */
+    int _argc;
+    string *_argv;
     string *includes;
     int _c_includes;
+    int _include_depth;
     int _in_set;
     int _out_set;
 
@@ -38,6 +113,55 @@ typedef struct CPreprocessor {
  */
 int cpreprocessor_init(CPreprocessor *const this, int argc, string argv[]);
 
+/**
+ * @brief Initialise a batch worker. The worker shares the macros defined on the
+ * command line and the include directories with the base preprocessor, and
+ * only reads them; everything else (the macros defined by the inputs, the
+ * caches) belongs to the worker
+ * @param this The "object" this functions is attached to
+ * @param base The preprocessor that parsed the command line
+ * @return int The return code
+ */
+int cpreprocessor_init_worker(CPreprocessor *const this,
+                              CPreprocessor *const base);
+
+/**
+ * @brief Preprocess one input into one output. For batch workers, the macros
+ * state is reset to the command line state before the input is processed
+ * @param this The "object" this functions is attached to
+ * @param input The input file (NULL for stdin)
+ * @param output The output file (NULL for stdout)
+ * @return int The return code
+ */
+int cpreprocessor_process(CPreprocessor *const this, string input,
+                          string output);
+
+/**
+ * @brief Preprocess one opened input into one opened output (the files are not
+ * closed). For batch workers, the macros state is reset to the command line
+ * state before the input is processed
+ * @param this The "object" this functions is attached to
+ * @param i_fd The input
+ * @param in_path The path of the input (NULL for stdin)
+ * @param o_fd The output
+ * @return int The return code
+ */
+int cpreprocessor_process_files(CPreprocessor *const this, FILE *i_fd,
+                                string in_path, FILE *o_fd);
+
+/**
+ * @brief Get the value of a command line option, if the option takes one.
+ * The value is the rest of the argument, or the next argument. The server
+ * splits its requests with it too, so both read the same options.
+ * @param argc The arguments count
+ * @param argv The arguments vector
+ * @param i The index of the option (moved if the value is separate)
+ * @param value The value (NULL if the option takes none)
+ * @return int 1 if the option takes a value, 0 if not, FILE_ERR if the value
+ * is missing
+ */
+int cpreprocessor_option(int argc, string argv[], int *i, string *value);
+
 /**
  * @brief Run the main logic behind the c preprocessor
  * @param this The "object" this functions is attached to
@@ -0,0 +1,144 @@
+/**
+ * @file deps.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the make-style dependency output
+ * @copyright Copyright (c) 2021
+ */
+
+#include "deps.h"
+
+/**
+ * @brief Build a new path, by replacing the extension of a path
+ * @param path The path
+ * @param ext The new extension (with the dot)
+ * @param keep_dir Keep the directory of the path (FALSE to keep only the name)
+ * @param result The new path (must be freed)
+ * @return int The return code
+ */
+int _replace_ext(const char *path, const char *ext, int keep_dir,
+                 string *result) {
+    const char *name = path + strlen(path);
+    const char *start;
+    const char *end;
+
+    while (name != path && name[-1] != '/' && name[-1] != '\\') { name--; }
+
+    /* A name that starts with a dot has no extension */
+    end = strrchr(name, '.');
+    if (end == NULL || end == name) { end = name + strlen(name); }
+
+    start = keep_dir ? path : name;
+    *result = calloc(end - start + strlen(ext) + 1, 1);
+    if (*result == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the path");
+        return MALLOC_ERR;
+    }
+
+    memcpy(*result, start, end - start);
+    strcpy(*result + (end - start), ext);
+    return 0;
+}
+
+/**
+ * @brief Write a path of a rule, escaping the characters that make treats
+ * differently (the blanks, '$' and '#')
+ * @param fd The file of the rule
+ * @param path The path
+ */
+void _write_path(FILE *fd, const char *path) {
+    for (; *path != '\0'; ++path) {
+        if (*path == ' ' || *path == '\t' || *path == '#') {
+            fputc('\\', fd);
+        } else if (*path == '$') {
+            fputc('$', fd);
+        }
+        fputc(*path, fd);
+    }
+}
+
+/**
+ * @brief Open the file the rule is written in
+ * @param proc The preprocessor
+ * @param input The input path (NULL for stdin)
+ * @param output The output path (NULL for stdout)
+ * @param fd The opened file
+ * @return int The return code
+ */
+int _open_deps(CPreprocessor *const proc, string input, string output,
+               FILE **fd) {
+    const char *base = output != NULL ? output : input;
+    string path;
+    int ret_code;
+
+    /* With -M, the preprocessed text is not written at all, so -MF only moves
+     * the rule from the output into its own file */
+    if (proc->dep_file != NULL) {
+        *fd = fopen(proc->dep_file, "w");
+    } else if (proc->deps == DEPS_ONLY) {
+        *fd = output != NULL ? fopen(output, "w") : stdout;
+    } else {
+        if (base == NULL) {
+            CERR(TRUE, "The dependency file needs a name (-MF)");
+            return FILE_ERR;
+        }
+
+        ret_code = _replace_ext(base, ".d", TRUE, &path);
+        if (ret_code != 0) { return ret_code; }
+
+        *fd = fopen(path, "w");
+        free(path);
+    }
+
+    if (*fd == NULL) {
+        CERR(TRUE, "Couldn't open the dependency file");
+        return FILE_ERR;
+    }
+    return 0;
+}
+
+int deps_write(CPreprocessor *const proc, string input, string output) {
+    const char *const *paths;
+    string target = NULL;
+    FILE *fd;
+    int count;
+    int ret_code;
+    int i;
+
+    /* The target is the object of the input, if it wasn't set */
+    if (proc->dep_target == NULL && input != NULL) {
+        ret_code = _replace_ext(input, ".o", FALSE, &target);
+        if (ret_code != 0) { return ret_code; }
+    }
+
+    ret_code = _open_deps(proc, input, output, &fd);
+    if (ret_code != 0) {
+        free(target);
+        return ret_code;
+    }
+
+    if (proc->dep_target != NULL) {
+        _write_path(fd, proc->dep_target);
+    } else {
+        _write_path(fd, target != NULL ? target : "-");
+    }
+    fputc(':', fd);
+
+    if (input != NULL) {
+        fputc(' ', fd);
+        _write_path(fd, input);
+    }
+
+    proc->resolver.recorded(&proc->resolver, &paths, &count);
+    for (i = 0; i < count; ++i) {
+        fputs(" \\\n ", fd);
+        _write_path(fd, paths[i]);
+    }
+    fputc('\n', fd);
+    free(target);
+
+    if (ferror(fd)) { ret_code = IO_ERR; }
+    if ((fd == stdout ? fflush(fd) : fclose(fd)) != 0) { ret_code = IO_ERR; }
+
+    if (ret_code != 0) { CERR(TRUE, "Couldn't write the dependency file"); }
+    return ret_code;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file deps.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the make-style dependency output
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef DEPS_H
+#define DEPS_H
+
+#include "cpreprocessor.h"
+
+/**
+ * @brief Write the make rule of an input, after it was processed: the target
+ * depends on the input and on every file included by it (as they were found
+ * by the include resolver, each of them once). The rule is written in the
+ * file set by -MF; otherwise, with -M it replaces the output, and with -MD it
+ * is written next to the output (or the input), with the ".d" extension. The
+ * target (the object of the input, or the one set by -MT) is escaped like the
+ * paths. With -M, the preprocessed text is never written (with -MF too, so
+ * nothing is written to the output).
+ * @param proc The preprocessor that processed the input
+ * @param input The input path (NULL for stdin)
+ * @param output The output path (NULL for stdout)
+ * @return int The return code
+ */
+int deps_write(CPreprocessor *const proc, string input, string output);
+
+#endif
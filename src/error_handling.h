@@ -23,6 +23,8 @@
 #define FALSE 0
 
 #define MALLOC_ERR -12
+#define FILE_ERR -2
+#define IO_ERR -5
 
 /**
  * @brief If the assertion is true, print error information
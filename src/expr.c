@@ -0,0 +1,894 @@
+/**
+ * @file expr.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the #if expressions. The text is parsed once
+ * (recursive descent, with precedence climbing for the binary operators) into
+ * the bytecode of a small stack machine. The && / || / ?: operators are
+ * compiled to jumps, so only the operands that decide the result are
+ * evaluated. Like in cpp, the macros are replaced before the expression is
+ * parsed, so their values can hold any part of it (operators, parentheses).
+ * @copyright Copyright (c) 2021
+ */
+
+#include "expr.h"
+
+#include <ctype.h>
+#include <limits.h>
+
+/* The kinds of tokens of an expression */
+#define ET_END 0
+#define ET_NUMBER 1
+#define ET_IDENT 2
+#define ET_BINARY 3 /* A binary operator (its instruction is in "op") */
+#define ET_LAND 4
+#define ET_LOR 5
+#define ET_NOT 6
+#define ET_COMPL 7
+#define ET_LPAREN 8
+#define ET_RPAREN 9
+#define ET_QUESTION 10
+#define ET_COLON 11
+
+#define EXPR_PARENS_MAX 256 /* The maximum nesting of the parentheses */
+
+/* The result of an operation computed on unsigned longs, so the overflows wrap
+ * around (as the other preprocessors do) instead of being undefined */
+#define EXPR_WRAP(value) ((long)(unsigned long)(value))
+
+/**
+ * @brief A value of the evaluation stack. The unsigned values are stored in
+ * the same bits, and converted back when they are used.
+ */
+typedef struct ExprValue {
+    long value;
+    int is_unsigned;
+} ExprValue;
+
+/**
+ * @brief The state of the compilation of an expression
+ */
+typedef struct ExprParser {
+    const char *curr; /* The first character after the current token */
+    int token;
+    int op;           /* The instruction of a binary operator */
+    long value;       /* The value of a number */
+    int is_unsigned;  /* The type of the number, then of the parsed operand */
+    const char *text; /* The start of an identifier */
+    size_t len;       /* The length of an identifier */
+    int count;        /* The number of emitted instructions */
+    int c_names;      /* The number of found identifiers */
+    int depth;        /* The nesting of the parentheses */
+    int error;        /* 0, FILE_ERR or MALLOC_ERR */
+    ExprCache *cache;
+    AtomTable *atoms;
+} ExprParser;
+
+/* The precedence of the binary operators (from EXPR_MUL to EXPR_OR) */
+const int _expr_precedence[EXPR_OR - EXPR_MUL + 1] = {
+    10, 10, 10, /* * / % */
+    9,  9,      /* + - */
+    8,  8,      /* << >> */
+    7,  7,  7, 7, /* < > <= >= */
+    6,  6,      /* == != */
+    5,          /* & */
+    4,          /* ^ */
+    3};         /* | */
+
+/* The precedence of && and || */
+#define PRECEDENCE_LAND 2
+#define PRECEDENCE_LOR 1
+
+/**
+ * @brief Check if a character can be part of an identifier
+ * @param c The character
+ * @return int TRUE or FALSE
+ */
+int _expr_is_ident(char c) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9');
+}
+
+/**
+ * @brief Read the value of an escape sequence (the backslash was already read)
+ * @param c The first character of the sequence. It is moved after it.
+ * @param value The value
+ * @return int TRUE for a valid sequence, FALSE otherwise
+ */
+int _expr_escape(const char **c, long *value) {
+    const char *simple = "n\nt\tr\rv\vf\fa\ab\b\\\\''\"\"??";
+    int digits = 0;
+
+    for (; *simple != '\0'; simple += 2) {
+        if (**c == simple[0]) {
+            *value = (uchar)simple[1];
+            (*c)++;
+            return TRUE;
+        }
+    }
+
+    *value = 0;
+    if (**c == 'x') {
+        /* Hexadecimal, with any number of digits */
+        for ((*c)++; isxdigit((uchar)**c); (*c)++, digits++) {
+            *value = *value * 16 +
+                     (isdigit((uchar)**c) ? **c - '0'
+                                          : tolower((uchar)**c) - 'a' + 10);
+        }
+    } else {
+        /* Octal, with up to three digits */
+        for (; digits < 3 && **c >= '0' && **c <= '7'; (*c)++, digits++) {
+            *value = *value * 8 + (**c - '0');
+        }
+    }
+
+    return digits != 0;
+}
+
+/**
+ * @brief Read a character literal (the quote was already read). Its value is
+ * a char, converted to int (so it is negative above 127, if char is signed).
+ * @param p The parser
+ */
+void _expr_char_literal(ExprParser *const p) {
+    const char *c = p->curr;
+
+    if (*c == '\\') {
+        c++;
+        if (!_expr_escape(&c, &p->value)) {
+            p->error = FILE_ERR;
+            p->token = ET_END;
+            return;
+        }
+    } else if (*c == '\'' || *c == '\0') {
+        p->error = FILE_ERR;
+        p->token = ET_END;
+        return;
+    } else {
+        p->value = (uchar)*c++;
+    }
+
+    if (*c != '\'') {
+        p->error = FILE_ERR;
+        p->token = ET_END;
+        return;
+    }
+    p->value = (char)p->value;
+    p->is_unsigned = FALSE;
+    p->curr = c + 1;
+    p->token = ET_NUMBER;
+}
+
+/**
+ * @brief Read the next token of the expression
+ * @param p The parser
+ */
+void _expr_next_token(ExprParser *const p) {
+    const char *c = p->curr;
+    char *end;
+
+    /* Skip the blanks and the comments */
+    for (;;) {
+        while (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n') { c++; }
+
+        if (c[0] == '/' && c[1] == '*' && (end = strstr(c + 2, "*/")) != NULL) {
+            c = end + 2;
+        } else if (c[0] == '/' && c[1] == '/') {
+            c += strlen(c);
+        } else {
+            break;
+        }
+    }
+
+    p->token = ET_BINARY;
+    p->curr = c + 1;
+
+    switch (*c) {
+        case '\0':
+            p->token = ET_END;
+            p->curr = c;
+            return;
+        case '(': p->token = ET_LPAREN; return;
+        case ')': p->token = ET_RPAREN; return;
+        case '?': p->token = ET_QUESTION; return;
+        case ':': p->token = ET_COLON; return;
+        case '~': p->token = ET_COMPL; return;
+        case '*': p->op = EXPR_MUL; return;
+        case '/': p->op = EXPR_DIV; return;
+        case '%': p->op = EXPR_MOD; return;
+        case '+': p->op = EXPR_ADD; return;
+        case '-': p->op = EXPR_SUB; return;
+        case '^': p->op = EXPR_XOR; return;
+        case '\'':
+            _expr_char_literal(p);
+            return;
+        default: break;
+    }
+
+    /* The operators that can have two characters */
+    p->curr = c + 2;
+    if (c[0] == '<' && c[1] == '<') { p->op = EXPR_SHL; return; }
+    if (c[0] == '>' && c[1] == '>') { p->op = EXPR_SHR; return; }
+    if (c[0] == '<' && c[1] == '=') { p->op = EXPR_LE; return; }
+    if (c[0] == '>' && c[1] == '=') { p->op = EXPR_GE; return; }
+    if (c[0] == '=' && c[1] == '=') { p->op = EXPR_EQ; return; }
+    if (c[0] == '!' && c[1] == '=') { p->op = EXPR_NE; return; }
+    if (c[0] == '&' && c[1] == '&') { p->token = ET_LAND; return; }
+    if (c[0] == '|' && c[1] == '|') { p->token = ET_LOR; return; }
+
+    p->curr = c + 1;
+    switch (*c) {
+        case '<': p->op = EXPR_LT; return;
+        case '>': p->op = EXPR_GT; return;
+        case '&': p->op = EXPR_AND; return;
+        case '|': p->op = EXPR_OR; return;
+        case '!': p->token = ET_NOT; return;
+        default: break;
+    }
+
+    if (*c >= '0' && *c <= '9') {
+        unsigned long number;
+
+        p->token = ET_NUMBER;
+        errno = 0;
+        number = strtoul(c, &end, 0);
+        if (errno == ERANGE) {
+            DEBUG_MSG("Integer constant too large in an #if expression");
+            p->error = FILE_ERR;
+            p->token = ET_END;
+            return;
+        }
+
+        /* A 'u' suffix, or a value that doesn't fit a long, is unsigned */
+        p->value = EXPR_WRAP(number);
+        p->is_unsigned = number > LONG_MAX;
+        while (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L') {
+            if (*end == 'u' || *end == 'U') { p->is_unsigned = TRUE; }
+            end++;
+        }
+        p->curr = end;
+        return;
+    }
+
+    if (_expr_is_ident(*c)) {
+        p->token = ET_IDENT;
+        p->text = c;
+        while (_expr_is_ident(*c)) { c++; }
+        p->len = c - p->text;
+        p->curr = c;
+        return;
+    }
+
+    p->error = FILE_ERR;
+    p->token = ET_END;
+}
+
+/**
+ * @brief Append an instruction to the bytecode
+ * @param p The parser
+ * @param code The instruction
+ * @param value Its constant (or jump target)
+ * @param atom Its macro name
+ * @return int The index of the instruction
+ */
+int _expr_emit(ExprParser *const p, int code, long value, const Atom *atom) {
+    ExprCache *const cache = p->cache;
+
+    if (p->error != 0) { return 0; }
+
+    if (p->count == cache->_code_cap) {
+        int new_cap = cache->_code_cap == 0 ? 64 : cache->_code_cap * 2;
+        ExprOp *aux_buff = realloc(cache->_code, new_cap * sizeof(ExprOp));
+
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the expression");
+            p->error = MALLOC_ERR;
+            return 0;
+        }
+        cache->_code = aux_buff;
+        cache->_code_cap = new_cap;
+    }
+
+    cache->_code[p->count].code = code;
+    cache->_code[p->count].value = value;
+    cache->_code[p->count].atom = atom;
+    return p->count++;
+}
+
+/**
+ * @brief Record an identifier of the expression (its macro is expanded before
+ * the evaluation)
+ * @param p The parser
+ * @param atom The identifier
+ * @param start The offset of the identifier in the text
+ */
+void _expr_add_name(ExprParser *const p, const Atom *atom, size_t start) {
+    ExprCache *const cache = p->cache;
+
+    if (p->c_names == cache->_names_cap) {
+        int new_cap = cache->_names_cap == 0 ? 16 : cache->_names_cap * 2;
+        ExprName *aux_buff = realloc(cache->_names, new_cap * sizeof(ExprName));
+
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the expression");
+            p->error = MALLOC_ERR;
+            return;
+        }
+        cache->_names = aux_buff;
+        cache->_names_cap = new_cap;
+    }
+
+    cache->_names[p->c_names].atom = atom;
+    cache->_names[p->c_names].start = start;
+    p->c_names++;
+}
+
+/**
+ * @brief Check if the current token is the "defined" operator
+ * @param p The parser
+ * @return int TRUE or FALSE
+ */
+int _expr_is_defined(const ExprParser *const p) {
+    return p->token == ET_IDENT && p->len == 7 &&
+           strncmp(p->text, "defined", 7) == 0;
+}
+
+/**
+ * @brief Set the target of a jump to the next instruction
+ * @param p The parser
+ * @param jump The index of the jump
+ */
+void _expr_patch(ExprParser *const p, int jump) {
+    if (p->error == 0) { p->cache->_code[jump].value = p->count; }
+}
+
+void _expr_parse_conditional(ExprParser *const p);
+
+/**
+ * @brief Parse a primary expression (a number, an identifier, "defined" or an
+ * expression between parentheses)
+ * @param p The parser
+ */
+void _expr_parse_primary(ExprParser *const p) {
+    const Atom *atom;
+    int parens;
+    int ret_code;
+
+    if (p->token == ET_NUMBER) {
+        _expr_emit(p, p->is_unsigned ? EXPR_UCONST : EXPR_CONST, p->value,
+                   NULL);
+        _expr_next_token(p);
+    } else if (p->token == ET_LPAREN) {
+        if (++p->depth > EXPR_PARENS_MAX) {
+            p->error = FILE_ERR;
+            return;
+        }
+        _expr_next_token(p);
+        _expr_parse_conditional(p);
+        if (p->token != ET_RPAREN) { p->error = FILE_ERR; }
+        p->depth--;
+        _expr_next_token(p);
+    } else if (_expr_is_defined(p)) {
+        /* defined X, or defined(X) */
+        _expr_next_token(p);
+        parens = p->token == ET_LPAREN;
+        if (parens) { _expr_next_token(p); }
+        if (p->token != ET_IDENT) {
+            p->error = FILE_ERR;
+            return;
+        }
+
+        ret_code = p->atoms->intern(p->atoms, p->text, p->len, &atom);
+        if (ret_code < 0) {
+            p->error = ret_code;
+            return;
+        }
+        _expr_emit(p, EXPR_DEFINED, 0, atom);
+        p->is_unsigned = FALSE;
+
+        _expr_next_token(p);
+        if (parens) {
+            if (p->token != ET_RPAREN) { p->error = FILE_ERR; }
+            _expr_next_token(p);
+        }
+    } else if (p->token == ET_IDENT) {
+        /* The macros were replaced, the identifiers that are left are 0 */
+        _expr_emit(p, EXPR_CONST, 0, NULL);
+        p->is_unsigned = FALSE;
+        _expr_next_token(p);
+    } else {
+        p->error = FILE_ERR;
+    }
+}
+
+/**
+ * @brief Parse an unary expression
+ * @param p The parser
+ */
+void _expr_parse_unary(ExprParser *const p) {
+    int op;
+
+    if (p->token == ET_BINARY && (p->op == EXPR_ADD || p->op == EXPR_SUB)) {
+        op = p->op;
+        _expr_next_token(p);
+        _expr_parse_unary(p);
+        if (op == EXPR_SUB) { _expr_emit(p, EXPR_NEG, 0, NULL); }
+    } else if (p->token == ET_NOT || p->token == ET_COMPL) {
+        op = p->token == ET_NOT ? EXPR_NOT : EXPR_COMPL;
+        _expr_next_token(p);
+        _expr_parse_unary(p);
+        _expr_emit(p, op, 0, NULL);
+        if (op == EXPR_NOT) { p->is_unsigned = FALSE; }
+    } else {
+        _expr_parse_primary(p);
+    }
+}
+
+/**
+ * @brief Parse the binary operators with a precedence of at least "min". The
+ * type of the result is tracked, for the ?: operators.
+ * @param p The parser
+ * @param min The minimum precedence
+ */
+void _expr_parse_binary(ExprParser *const p, int min) {
+    int prec;
+    int op;
+    int jump;
+    int end;
+    int left_unsigned;
+
+    _expr_parse_unary(p);
+
+    while (p->error == 0) {
+        if (p->token == ET_BINARY) {
+            prec = _expr_precedence[p->op - EXPR_MUL];
+        } else if (p->token == ET_LAND) {
+            prec = PRECEDENCE_LAND;
+        } else if (p->token == ET_LOR) {
+            prec = PRECEDENCE_LOR;
+        } else {
+            break;
+        }
+        if (prec < min) { break; }
+
+        if (p->token == ET_BINARY) {
+            op = p->op;
+            left_unsigned = p->is_unsigned;
+            _expr_next_token(p);
+            _expr_parse_binary(p, prec + 1);
+            _expr_emit(p, op, 0, NULL);
+
+            /* The comparisons are ints, the shifts have the type of their
+             * left operand, the others are unsigned if any operand is */
+            if (op >= EXPR_LT && op <= EXPR_NE) {
+                p->is_unsigned = FALSE;
+            } else if (op == EXPR_SHL || op == EXPR_SHR) {
+                p->is_unsigned = left_unsigned;
+            } else {
+                p->is_unsigned = p->is_unsigned || left_unsigned;
+            }
+            continue;
+        }
+
+        /* The right operand of && / || is skipped if the left one decides
+         * the result */
+        op = p->token;
+        _expr_next_token(p);
+        jump = _expr_emit(p, op == ET_LAND ? EXPR_JZ : EXPR_JNZ, 0, NULL);
+        _expr_parse_binary(p, prec + 1);
+        _expr_emit(p, EXPR_BOOL, 0, NULL);
+        end = _expr_emit(p, EXPR_JMP, 0, NULL);
+        _expr_patch(p, jump);
+        _expr_emit(p, EXPR_CONST, op == ET_LAND ? 0 : 1, NULL);
+        _expr_patch(p, end);
+        p->is_unsigned = FALSE;
+    }
+}
+
+/**
+ * @brief Parse a conditional expression (c ? a : b). If one of the branches is
+ * unsigned, the result is converted (whichever branch is taken).
+ * @param p The parser
+ */
+void _expr_parse_conditional(ExprParser *const p) {
+    int jump;
+    int end;
+    int then_unsigned;
+
+    _expr_parse_binary(p, PRECEDENCE_LOR);
+    if (p->error != 0 || p->token != ET_QUESTION) { return; }
+
+    _expr_next_token(p);
+    jump = _expr_emit(p, EXPR_JZ, 0, NULL);
+    _expr_parse_conditional(p);
+    if (p->token != ET_COLON) {
+        p->error = FILE_ERR;
+        return;
+    }
+    then_unsigned = p->is_unsigned;
+
+    _expr_next_token(p);
+    end = _expr_emit(p, EXPR_JMP, 0, NULL);
+    _expr_patch(p, jump);
+    _expr_parse_conditional(p);
+    _expr_patch(p, end);
+
+    /* Both branches join here */
+    if (then_unsigned || p->is_unsigned) {
+        _expr_emit(p, EXPR_UNSIGNED, 0, NULL);
+        p->is_unsigned = TRUE;
+    }
+}
+
+/**
+ * @brief Find the identifiers of an expression (except the operands of
+ * "defined"). The whole text is walked, even if it can't be parsed, as the
+ * macros could make it valid.
+ * @param p The parser (at the start of the text)
+ * @param text The text
+ */
+void _expr_scan_names(ExprParser *const p, const char *text) {
+    const Atom *atom;
+    int ret_code;
+
+    _expr_next_token(p);
+    while (p->error == 0 && p->token != ET_END) {
+        if (_expr_is_defined(p)) {
+            /* defined X, or defined(X) */
+            _expr_next_token(p);
+            if (p->token == ET_LPAREN) { _expr_next_token(p); }
+            if (p->token == ET_IDENT) { _expr_next_token(p); }
+            continue;
+        }
+
+        if (p->token == ET_IDENT) {
+            ret_code = p->atoms->intern(p->atoms, p->text, p->len, &atom);
+            if (ret_code < 0) {
+                p->error = ret_code;
+                return;
+            }
+            _expr_add_name(p, atom, p->text - text);
+        }
+        _expr_next_token(p);
+    }
+}
+
+/**
+ * @brief Compile an expression, and store it in the cache
+ * @param this The cache
+ * @param atoms The table used to intern the identifiers
+ * @param text The atom of the expression text
+ * @param expr The compiled expression
+ * @return int The return code
+ */
+int _expr_compile(ExprCache *const this, AtomTable *const atoms,
+                  const Atom *text, Expr **expr) {
+    ExprParser p;
+    ExprParser names;
+    int count;
+
+    memset(&p, 0, sizeof(ExprParser));
+    p.curr = text->text;
+    p.cache = this;
+    p.atoms = atoms;
+    names = p;
+
+    _expr_next_token(&p);
+    _expr_parse_conditional(&p);
+    if (p.error == 0 && p.token != ET_END) { p.error = FILE_ERR; }
+    if (p.error == MALLOC_ERR) { return MALLOC_ERR; }
+
+    _expr_scan_names(&names, text->text);
+    if (names.error == MALLOC_ERR) { return MALLOC_ERR; }
+
+    /* The invalid expressions are cached too, with no bytecode */
+    count = p.error == 0 ? p.count : 0;
+    *expr = this->_storage.alloc(&this->_storage,
+                                 sizeof(Expr) + count * sizeof(ExprOp) +
+                                     names.c_names * sizeof(ExprName));
+    if (*expr == NULL) { return MALLOC_ERR; }
+
+    (*expr)->valid = p.error == 0;
+    (*expr)->count = count;
+    (*expr)->ops = (ExprOp *)(*expr + 1);
+    memcpy((*expr)->ops, this->_code, count * sizeof(ExprOp));
+    (*expr)->c_names = names.c_names;
+    (*expr)->names = (ExprName *)((*expr)->ops + count);
+    if (names.c_names != 0) {
+        memcpy((*expr)->names, this->_names, names.c_names * sizeof(ExprName));
+    }
+    return 0;
+}
+
+/**
+ * @brief Find the compiled expression of a text, compiling it if needed
+ * @param this The cache
+ * @param atoms The table used to intern the identifiers
+ * @param text The atom of the expression text
+ * @param expr The compiled expression
+ * @return int The return code
+ */
+int _expr_find(ExprCache *const this, AtomTable *const atoms, const Atom *text,
+               Expr **expr) {
+    int ret_code;
+
+    if (text->id >= this->_capacity) {
+        int new_capacity = this->_capacity == 0 ? 64 : this->_capacity;
+        Expr **aux_buff;
+
+        while (new_capacity <= text->id) { new_capacity *= 2; }
+        aux_buff = realloc(this->_exprs, new_capacity * sizeof(Expr *));
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the expressions");
+            return MALLOC_ERR;
+        }
+
+        memset(aux_buff + this->_capacity, 0,
+               (new_capacity - this->_capacity) * sizeof(Expr *));
+        this->_exprs = aux_buff;
+        this->_capacity = new_capacity;
+    }
+
+    if (this->_exprs[text->id] == NULL) {
+        ret_code = _expr_compile(this, atoms, text, &this->_exprs[text->id]);
+        if (ret_code < 0) { return ret_code; }
+    }
+
+    *expr = this->_exprs[text->id];
+    return 0;
+}
+
+/**
+ * @brief Compare two values (converted to the same type)
+ * @param code The instruction
+ * @param a The left operand
+ * @param b The right operand
+ * @return long The result (0 or 1)
+ */
+long _expr_compare(int code, const ExprValue *a, const ExprValue *b) {
+    int is_unsigned = a->is_unsigned || b->is_unsigned;
+    unsigned long ua = (unsigned long)a->value;
+    unsigned long ub = (unsigned long)b->value;
+
+    switch (code) {
+        case EXPR_LT: return is_unsigned ? ua < ub : a->value < b->value;
+        case EXPR_GT: return is_unsigned ? ua > ub : a->value > b->value;
+        case EXPR_LE: return is_unsigned ? ua <= ub : a->value <= b->value;
+        case EXPR_GE: return is_unsigned ? ua >= ub : a->value >= b->value;
+        case EXPR_EQ: return a->value == b->value;
+        default: return a->value != b->value;
+    }
+}
+
+/**
+ * @brief Apply a binary operator. The usual arithmetic conversions are done:
+ * if one of the operands is unsigned, both are (except for the shifts, whose
+ * result has the type of the left operand).
+ * @param code The instruction
+ * @param a The left operand (replaced by the result)
+ * @param b The right operand
+ * @return int The return code (FILE_ERR for a division by zero)
+ */
+int _expr_binary(int code, ExprValue *a, const ExprValue *b) {
+    unsigned long bits = sizeof(long) * CHAR_BIT;
+    unsigned long ua = (unsigned long)a->value;
+    unsigned long ub = (unsigned long)b->value;
+    int is_unsigned = a->is_unsigned || b->is_unsigned;
+    int shift_out; /* The shift count is negative or too large */
+
+    if (code >= EXPR_LT && code <= EXPR_NE) {
+        a->value = _expr_compare(code, a, b);
+        a->is_unsigned = FALSE;
+        return 0;
+    }
+
+    if (code == EXPR_SHL || code == EXPR_SHR) {
+        shift_out = b->is_unsigned ? ub >= bits : b->value < 0 || ub >= bits;
+        if (code == EXPR_SHL) {
+            a->value = shift_out ? 0 : EXPR_WRAP(ua << ub);
+        } else if (a->is_unsigned) {
+            a->value = shift_out ? 0 : EXPR_WRAP(ua >> ub);
+        } else {
+            a->value = shift_out ? (a->value < 0 ? -1 : 0) : a->value >> ub;
+        }
+        return 0;
+    }
+
+    switch (code) {
+        case EXPR_MUL: a->value = EXPR_WRAP(ua * ub); break;
+        case EXPR_DIV:
+        case EXPR_MOD:
+            if (ub == 0) {
+                DEBUG_MSG("Division by zero in an #if expression");
+                return FILE_ERR;
+            }
+            if (is_unsigned) {
+                a->value = EXPR_WRAP(code == EXPR_DIV ? ua / ub : ua % ub);
+            } else if (b->value == -1) {
+                /* LONG_MIN / -1 overflows even when it is computed, so it is
+                 * set directly (it wraps to LONG_MIN, like the other
+                 * overflows); the remainder is always 0 */
+                a->value = code != EXPR_DIV ? 0 : EXPR_WRAP(0UL - ua);
+            } else {
+                a->value =
+                    code == EXPR_DIV ? a->value / b->value : a->value % b->value;
+            }
+            break;
+        case EXPR_ADD: a->value = EXPR_WRAP(ua + ub); break;
+        case EXPR_SUB: a->value = EXPR_WRAP(ua - ub); break;
+        case EXPR_AND: a->value = EXPR_WRAP(ua & ub); break;
+        case EXPR_XOR: a->value = EXPR_WRAP(ua ^ ub); break;
+        case EXPR_OR: a->value = EXPR_WRAP(ua | ub); break;
+        default: return FILE_ERR;
+    }
+
+    a->is_unsigned = is_unsigned;
+    return 0;
+}
+
+/**
+ * @brief Run the bytecode of an expression
+ * @param expr The compiled expression
+ * @param resolve The function used to find the macros
+ * @param ctx The context passed to the resolve function
+ * @param result The value of the expression
+ * @return int The return code
+ */
+int _expr_run(const Expr *expr, ExprResolve resolve, void *ctx,
+              long *result) {
+    ExprValue stack[EXPR_STACK_MAX];
+    const ExprOp *op;
+    ExprValue *top;
+    int sp = 0;
+    int pc = 0;
+    int ret_code;
+
+    if (!expr->valid) {
+        DEBUG_MSG("Invalid #if expression");
+        return FILE_ERR;
+    }
+
+    while (pc < expr->count) {
+        op = &expr->ops[pc++];
+
+        if (sp == EXPR_STACK_MAX) {
+            DEBUG_MSG("The #if expression is too complex");
+            return FILE_ERR;
+        }
+        top = sp != 0 ? &stack[sp - 1] : stack;
+
+        switch (op->code) {
+            case EXPR_CONST:
+            case EXPR_UCONST:
+                stack[sp].value = op->value;
+                stack[sp++].is_unsigned = op->code == EXPR_UCONST;
+                break;
+            case EXPR_DEFINED:
+                ret_code = resolve(ctx, op->atom, NULL);
+                if (ret_code < 0) { return ret_code; }
+                stack[sp].value = ret_code == 0;
+                stack[sp++].is_unsigned = FALSE;
+                break;
+            case EXPR_JZ:
+                if (stack[--sp].value == 0) { pc = (int)op->value; }
+                break;
+            case EXPR_JNZ:
+                if (stack[--sp].value != 0) { pc = (int)op->value; }
+                break;
+            case EXPR_JMP: pc = (int)op->value; break;
+            case EXPR_BOOL:
+                top->value = top->value != 0;
+                top->is_unsigned = FALSE;
+                break;
+            case EXPR_NEG:
+                top->value = EXPR_WRAP(0UL - (unsigned long)top->value);
+                break;
+            case EXPR_NOT:
+                top->value = !top->value;
+                top->is_unsigned = FALSE;
+                break;
+            case EXPR_COMPL: top->value = ~top->value; break;
+            case EXPR_UNSIGNED: top->is_unsigned = TRUE; break;
+            default:
+                sp--;
+                ret_code = _expr_binary(op->code, &stack[sp - 1], &stack[sp]);
+                if (ret_code < 0) { return ret_code; }
+                break;
+        }
+    }
+
+    *result = stack[0].value;
+    return 0;
+}
+
+/**
+ * @brief Replace the macros of an expression by their values. The values are
+ * surrounded by blanks, so their tokens don't join the neighbouring ones.
+ * @param this The cache
+ * @param text The atom of the expression text
+ * @param expr The compiled expression (with its identifiers)
+ * @param resolve The function used to find the macros
+ * @param ctx The context passed to the resolve function
+ * @param expanded The atom of the resulting text, in the texts of the cache
+ * (NULL if there are no macros)
+ * @return int The return code
+ */
+int _expr_expand(ExprCache *const this, const Atom *text, const Expr *expr,
+                 ExprResolve resolve, void *ctx, const Atom **expanded) {
+    StringBuilder *const out = &this->_expansion;
+    const ExprName *name;
+    string value;
+    size_t pos = 0;
+    int found = FALSE;
+    int ret_code = 0;
+    int i;
+
+    *expanded = NULL;
+    out->reset(out);
+
+    for (i = 0; i < expr->c_names && ret_code >= 0; ++i) {
+        name = &expr->names[i];
+        ret_code = resolve(ctx, name->atom, &value);
+        if (ret_code != 0) { continue; }
+
+        found = TRUE;
+        ret_code = out->append_span(out, text->text + pos, name->start - pos);
+        if (ret_code == 0) { ret_code = out->append(out, " "); }
+        if (ret_code == 0) { ret_code = out->append(out, value); }
+        if (ret_code == 0) { ret_code = out->append(out, " "); }
+        pos = name->start + name->atom->len;
+    }
+    if (ret_code < 0 || !found) { return ret_code < 0 ? ret_code : 0; }
+
+    ret_code = out->append_span(out, text->text + pos, text->len - pos);
+    if (ret_code < 0) { return ret_code; }
+
+    return this->_texts.intern(&this->_texts, out->data, out->len, expanded);
+}
+
+int exprcache_eval(ExprCache *const this, AtomTable *const atoms,
+                   const char *text, ExprResolve resolve, void *ctx,
+                   long *result) {
+    const Atom *key;
+    const Atom *expanded;
+    Expr *expr;
+    int ret_code;
+
+    if (this->_texts._slots == NULL) {
+        ret_code = this->_texts.init(&this->_texts);
+        if (ret_code < 0) { return ret_code; }
+    }
+    ret_code = this->_texts.intern(&this->_texts, text, strlen(text), &key);
+    if (ret_code < 0) { return ret_code; }
+
+    ret_code = _expr_find(this, atoms, key, &expr);
+    if (ret_code < 0) { return ret_code; }
+
+    ret_code = _expr_expand(this, key, expr, resolve, ctx, &expanded);
+    if (ret_code < 0) { return ret_code; }
+
+    /* The values are fully expanded, the names left in them are not macros
+     * anymore (they are 0) */
+    if (expanded != NULL) {
+        ret_code = _expr_find(this, atoms, expanded, &expr);
+        if (ret_code < 0) { return ret_code; }
+    }
+
+    return _expr_run(expr, resolve, ctx, result);
+}
+
+int exprcache_clear(ExprCache *const this) {
+    this->_texts.clear(&this->_texts);
+    this->_storage.clear(&this->_storage);
+    this->_expansion.clear(&this->_expansion);
+    free(this->_exprs);
+    free(this->_code);
+    free(this->_names);
+
+    this->_exprs = NULL;
+    this->_code = NULL;
+    this->_names = NULL;
+    this->_capacity = 0;
+    this->_code_cap = 0;
+    this->_names_cap = 0;
+    return 0;
+}
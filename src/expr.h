@@ -0,0 +1,147 @@
+/**
+ * @file expr.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the #if expressions (compiled to bytecode)
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef EXPR_H
+#define EXPR_H
+
+#include "arena.h"
+#include "atoms.h"
+#include "strbuf.h"
+
+#define EXPR_STACK_MAX 64 /* The maximum depth of the evaluation stack */
+
+/* A "constructor" for the expressions cache */
+#define INIT_EXPRCACHE                                                   \
+    {                                                                    \
+        0, 0, INIT_ATOMTABLE, INIT_ARENA, 0, 0, 0, 0, INIT_STRBUF,       \
+            exprcache_eval, exprcache_clear                              \
+    }
+
+/* The instructions of the bytecode */
+#define EXPR_CONST 0    /* Push the (signed) value */
+#define EXPR_UCONST 1   /* Push the value, as an unsigned one */
+#define EXPR_DEFINED 2  /* Push 1 if a macro is defined, 0 otherwise */
+#define EXPR_JZ 3       /* Pop, and jump if the value is 0 */
+#define EXPR_JNZ 4      /* Pop, and jump if the value is not 0 */
+#define EXPR_JMP 5      /* Jump */
+#define EXPR_BOOL 6     /* Replace the top with 0 or 1 */
+#define EXPR_NEG 7      /* The unary operators */
+#define EXPR_NOT 8
+#define EXPR_COMPL 9
+#define EXPR_MUL 10 /* The binary operators, in the order of their tokens */
+#define EXPR_DIV 11
+#define EXPR_MOD 12
+#define EXPR_ADD 13
+#define EXPR_SUB 14
+#define EXPR_SHL 15
+#define EXPR_SHR 16
+#define EXPR_LT 17
+#define EXPR_GT 18
+#define EXPR_LE 19
+#define EXPR_GE 20
+#define EXPR_EQ 21
+#define EXPR_NE 22
+#define EXPR_AND 23
+#define EXPR_XOR 24
+#define EXPR_OR 25
+#define EXPR_UNSIGNED 26 /* Make the top unsigned (the result of a ?:) */
+
+/**
+ * @brief An instruction of a compiled expression
+ */
+typedef struct ExprOp {
+    int code;
+    long value;       /* The constant, or the target of a jump */
+    const Atom *atom; /* The macro name, for EXPR_DEFINED */
+} ExprOp;
+
+/**
+ * @brief An identifier of an expression (outside "defined"), that is replaced
+ * by its macro before the expression is evaluated
+ */
+typedef struct ExprName {
+    const Atom *atom;
+    size_t start; /* The offset of the identifier in the text */
+} ExprName;
+
+/**
+ * @brief A compiled expression. Its identifiers are compiled as 0, so the
+ * bytecode is only run when none of them is a macro.
+ */
+typedef struct Expr {
+    int valid; /* FALSE if the text couldn't be parsed */
+    int count;
+    ExprOp *ops;
+    int c_names;
+    ExprName *names;
+} Expr;
+
+/**
+ * @brief The function used to find the macros of an expression
+ * @param ctx The context of the evaluation
+ * @param name The name of the macro
+ * @param value The full expansion of the macro (NULL if only the definition
+ * is checked). It must stay valid until the expression is evaluated.
+ * @return int The return code (0 - defined, 1 - not defined, negative for
+ * errors)
+ */
+typedef int (*ExprResolve)(void *ctx, const Atom *name, string *value);
+
+/**
+ * @brief The cache of the compiled expressions. Every expression is compiled
+ * once, the first time it is evaluated, and it is found again by its text
+ * (the texts have their own table, apart from the identifiers). When some of
+ * its identifiers are macros, they are replaced by their values, and the
+ * resulting text is compiled (and cached) instead, so the cache is valid for
+ * any set of definitions.
+ */
+typedef struct ExprCache {
+    Expr **_exprs; /* Indexed by the ids of the texts */
+    int _capacity;
+    AtomTable _texts; /* The texts of the expressions */
+    Arena _storage;  /* The memory of the compiled expressions */
+    ExprOp *_code;   /* The bytecode that is being compiled */
+    int _code_cap;
+    ExprName *_names; /* The identifiers of the expression being compiled */
+    int _names_cap;
+    StringBuilder _expansion; /* The text with the macros replaced */
+
+    int (*eval)(struct ExprCache *const this, AtomTable *const atoms,
+                const char *text, ExprResolve resolve, void *ctx,
+                long *result);
+    int (*clear)(struct ExprCache *const this);
+} ExprCache;
+
+/**
+ * @brief Evaluate an integer constant expression (the condition of an #if or
+ * of an #elif), compiling it first, if it wasn't seen before. The identifiers
+ * are replaced by the values of their macros (the tokens of the values become
+ * part of the expression), the ones that are left are 0, and "defined X" /
+ * "defined(X)" checks if X is a macro. The values are signed or unsigned
+ * longs, converted like in C (a 'u' suffix, or a constant that doesn't fit a
+ * long, is unsigned).
+ * @param this The cache this function is attached to
+ * @param atoms The table used to intern the identifiers
+ * @param text The expression text
+ * @param resolve The function used to find the macros
+ * @param ctx The context passed to the resolve function
+ * @param result The value of the expression
+ * @return int The return code (0 for no errors, FILE_ERR for invalid
+ * expressions)
+ */
+int exprcache_eval(ExprCache *const this, AtomTable *const atoms,
+                   const char *text, ExprResolve resolve, void *ctx,
+                   long *result);
+
+/**
+ * @brief Free all the compiled expressions
+ * @param this The cache this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int exprcache_clear(ExprCache *const this);
+
+#endif
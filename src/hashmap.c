@@ -7,35 +7,47 @@
 
 #include "hashmap.h"
 
+#include <time.h>
+
+#include "stats.h"
+
+/* The selected hashing function, and its seed */
+int _hash_id = HASH_DEFAULT;
+unsigned long _hash_seed = 0;
+
 /**
- * @brief A hashing function for a char array/string
+ * @brief A hashing function for a char array
  * Code taken from http://www.cse.yorku.ca/~oz/hash.html (djb2)
  * @param str The string to hash
+ * @param len The length of the string
+ * @param seed The seed (mixed into the initial value)
  * @return unsigned long The hash
  */
-unsigned long hash_djb2(string str) {
-    unsigned long hash = 5381;
-    int c;
+unsigned long hash_djb2(const char *str, size_t len, unsigned long seed) {
+    unsigned long hash = 5381 ^ seed;
 
-    while ((c = *str++)) {
+    while (len-- != 0) {
         /* hash * 33 + c */
-        hash = ((hash << 5) + hash) + c;
+        hash = ((hash << 5) + hash) + (uchar)*str++;
     }
 
     return hash;
 }
 
 /**
- * @brief A hashing function for a char array/string
+ * @brief A hashing function for a char array
  * Code taken from http://www.cse.yorku.ca/~oz/hash.html (sdbm)
  * @param str The string to hash
+ * @param len The length of the string
+ * @param seed The seed (the initial value)
  * @return unsigned long The hash
  */
-unsigned long hash_sdbm(string str) {
-    unsigned long hash = 0;
-    int c;
+unsigned long hash_sdbm(const char *str, size_t len, unsigned long seed) {
+    unsigned long hash = seed;
 
-    while ((c = *str++)) { hash = c + (hash << 6) + (hash << 16) - hash; }
+    while (len-- != 0) {
+        hash = (uchar)*str++ + (hash << 6) + (hash << 16) - hash;
+    }
 
     return hash;
 }
@@ -45,17 +57,21 @@ unsigned long hash_sdbm(string str) {
  * hash algorithm, but because (for some stupid reason) I can't use hash
  * functions from the internet, that ensure a good spread for the hash values
  * (which took some time to create & refine, as it's not exactly an exact
- * science) it's the best I could do.
+ * science) it's the best I could do. The characters with even codes multiply
+ * the hash by powers of two, so long words end up with few distinct hashes.
  * @param str The string to hash
+ * @param len The length of the string
+ * @param seed The seed (the initial value)
  * @return unsigned long The hash
  */
-unsigned long hash_personal(string str) {
-    unsigned long hash = 0;
+unsigned long hash_personal(const char *str, size_t len, unsigned long seed) {
+    unsigned long hash = seed;
     int c;
 
     uchar op = 0;
 
-    while ((c = *str++)) {
+    while (len-- != 0) {
+        c = *str++;
         switch (op % 2) {
             case 0: {
                 hash += c;
@@ -72,122 +88,427 @@ unsigned long hash_personal(string str) {
 }
 
 /**
- * @brief Hash a string. This is a wrapper function, that can use different
- * hashing functions. For the homework, it uses a simple (and bad) hashing
- * function I created.
- * @param src The string to hash
+ * @brief A hashing function for a char array, based on MurmurHash64A (by
+ * Austin Appleby). It reads a whole word at a time, and every bit of the input
+ * affects every bit of the hash. On 32-bit words, the constant is truncated
+ * and the shift is shorter, so it stays valid (but it is a weaker hash).
+ * @param str The string to hash
+ * @param len The length of the string
+ * @param seed The seed
  * @return unsigned long The hash
  */
-unsigned long hash(string src) { return hash_personal(src); }
+unsigned long hash_murmur(const char *str, size_t len, unsigned long seed) {
+    /* 0xc6a4a7935bd1e995 (without 64-bit constants, that C89 doesn't have) */
+    const unsigned long m = ((0xc6a4a793UL << 16) << 16) | 0x5bd1e995UL;
+    const int r = sizeof(unsigned long) * 8 - 17;
+    unsigned long hash = seed ^ (len * m);
+    unsigned long k;
+
+    while (len >= sizeof(unsigned long)) {
+        memcpy(&k, str, sizeof(unsigned long));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        hash ^= k;
+        hash *= m;
+
+        str += sizeof(unsigned long);
+        len -= sizeof(unsigned long);
+    }
+
+    /* The last (incomplete) word */
+    if (len != 0) {
+        while (len-- != 0) {
+            hash ^= (unsigned long)(uchar)str[len] << (8 * len);
+        }
+        hash *= m;
+    }
+
+    hash ^= hash >> r;
+    hash *= m;
+    hash ^= hash >> r;
+    return hash;
+}
+
+/* The hashing functions, in the order of their ids */
+unsigned long (*const _hash_functions[HASH_FUNCTIONS])(const char *, size_t,
+                                                       unsigned long) = {
+    hash_murmur, hash_djb2, hash_sdbm, hash_personal};
+
+/* The names of the hashing functions, in the order of their ids */
+const char *const _hash_names[HASH_FUNCTIONS] = {"murmur", "djb2", "sdbm",
+                                                 "personal"};
+
+int hash_use(const char *name, unsigned long seed) {
+    int i;
+
+    if (name != NULL) {
+        for (i = 0; i < HASH_FUNCTIONS; ++i) {
+            if (strcmp(name, _hash_names[i]) == 0) { break; }
+        }
+        if (i == HASH_FUNCTIONS) { return 1; }
+
+        _hash_id = i;
+    }
+
+    _hash_seed = seed;
+    return 0;
+}
+
+void hash_config(int *id, unsigned long *seed) {
+    *id = _hash_id;
+    *seed = _hash_seed;
+}
+
+const char *hash_name(int id) {
+    return id >= 0 && id < HASH_FUNCTIONS ? _hash_names[id] : NULL;
+}
+
+unsigned long hash_random_seed(void) {
+    unsigned long seed = (unsigned long)time(NULL);
+    int local;
+
+    /* The address of the stack differs between runs (if it is randomised) */
+    seed = seed * 31 + (unsigned long)clock();
+    seed = seed * 31 + (unsigned long)(size_t)&local;
+    return hash_murmur((const char *)&seed, sizeof(seed), seed);
+}
+
+unsigned long hash_span_with(int id, unsigned long seed, const char *src,
+                             size_t len) {
+    return _hash_functions[id](src, len, seed);
+}
+
+unsigned long hash_span(const char *src, size_t len) {
+    return _hash_functions[_hash_id](src, len, _hash_seed);
+}
+
+unsigned long hash(string src) { return hash_span(src, strlen(src)); }
+
+unsigned long hash_slot(unsigned long hash, unsigned long capacity) {
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3bUL;
+    hash ^= hash >> 16;
+    return hash & (capacity - 1);
+}
+
+/**
+ * @brief Place an (already allocated) entry into a slots array, using the
+ * "robin hood" strategy: an entry that is further from its home slot takes the
+ * place of one that is closer to its own. The key must not exist in the array.
+ * @param slots The slots array
+ * @param capacity The number of slots
+ * @param id The slot where the placing starts
+ * @param entry The entry to place (its _dist field must match the slot)
+ * @return int 1 if the probe length exceeded HASHMAP_PROBE_MAX (past keys with
+ * other hashes), 0 otherwise
+ */
+int _place_at(HashmapSlot *slots, int capacity, unsigned long id,
+              HashmapSlot entry) {
+    unsigned long mask = (unsigned long)(capacity - 1);
+    int long_probe = FALSE;
+
+    /* A long probe only counts if it passed keys with other hashes: the keys
+     * with the same full hash collide in an array of any size */
+    if (entry._dist > HASHMAP_PROBE_MAX &&
+        slots[(id - 1) & mask].hash != entry.hash) {
+        long_probe = TRUE;
+    }
+
+    while (slots[id]._dist != 0) {
+        if (entry._dist >= HASHMAP_PROBE_MAX && slots[id].hash != entry.hash) {
+            long_probe = TRUE;
+        }
+        if (slots[id]._dist < entry._dist) {
+            /* The current slot is "richer", so swap them */
+            HashmapSlot aux = slots[id];
+            slots[id] = entry;
+            entry = aux;
+        }
+
+        id = (id + 1) & mask;
+        entry._dist++;
+    }
+
+    slots[id] = entry;
+    return long_probe;
+}
+
+/**
+ * @brief Place an (already allocated) entry into a slots array, starting from
+ * its home slot (see _place_at)
+ * @param slots The slots array
+ * @param capacity The number of slots
+ * @param entry The entry to place (the _dist field is overwritten)
+ * @return int 1 if the probe length exceeded HASHMAP_PROBE_MAX, 0 otherwise
+ */
+int _place_slot(HashmapSlot *slots, int capacity, HashmapSlot entry) {
+    entry._dist = 1;
+    return _place_at(slots, capacity, hash_slot(entry.hash, capacity), entry);
+}
+
+/**
+ * @brief Search a key in a slots array. If the key is not found, the search
+ * stops where the key would be inserted.
+ * @param slots The slots array
+ * @param capacity The number of slots
+ * @param key The searched key
+ * @param h The hash of the key
+ * @param stop The slot where the search stopped
+ * @param dist The probe length of that slot
+ * @return HashmapSlot* The slot, or NULL if the key is not in the array
+ */
+HashmapSlot *_probe_slots(HashmapSlot *slots, int capacity, string key,
+                          unsigned long h, unsigned long *stop,
+                          unsigned int *dist) {
+    unsigned long mask = (unsigned long)(capacity - 1);
+    unsigned long id = hash_slot(h, capacity);
+    HashmapSlot *slot = NULL;
+
+    /* The probing stops at an empty slot, or at one that is closer to its
+     * home than the key would be (it would have been swapped on insert). The
+     * moved slots (of an old array) are skipped. */
+    *dist = 1;
+    while (slots[id]._dist >= *dist) {
+        if (slots[id].hash == h && slots[id]._dist != HASHMAP_MOVED &&
+            strcmp(slots[id].data.first, key) == 0) {
+            slot = &slots[id];
+            break;
+        }
+
+        id = (id + 1) & mask;
+        (*dist)++;
+    }
+
+    *stop = id;
+    return slot;
+}
+
+/**
+ * @brief Search a key in the current slots, or in the old ones, if they were
+ * not all moved yet
+ * @param this The hashmap
+ * @param key The searched key
+ * @param h The hash of the key
+ * @param stop Where the key would be inserted (in the current slots)
+ * @param dist The probe length of that slot
+ * @return HashmapSlot* The slot, or NULL if the key is not in the hashmap
+ */
+HashmapSlot *_search_slot(Hashmap *const this, string key, unsigned long h,
+                          unsigned long *stop, unsigned int *dist) {
+    unsigned long old_stop;
+    unsigned int old_dist = 0;
+    HashmapSlot *slot;
+
+    STATS_BEGIN(STATS_LOOKUP);
+
+    slot = _probe_slots(this->slots, this->_capacity, key, h, stop, dist);
+    if (slot == NULL && this->_old != NULL) {
+        slot = _probe_slots(this->_old, this->_old_capacity, key, h, &old_stop,
+                            &old_dist);
+    }
+
+    STATS_PROBE(*dist + old_dist);
+    STATS_END(STATS_LOOKUP, 0);
+    return slot;
+}
+
+/**
+ * @brief Find the slot that holds a key (in the current slots, or in the old
+ * ones, if they were not all moved yet)
+ * @param this The hashmap
+ * @param key The searched key
+ * @param h The hash of the key
+ * @return HashmapSlot* The slot, or NULL if the key is not in the hashmap
+ */
+HashmapSlot *_find_slot(Hashmap *const this, string key, unsigned long h) {
+    unsigned long stop;
+    unsigned int dist;
+
+    return _search_slot(this, key, h, &stop, &dist);
+}
+
+/**
+ * @brief Move some of the old slots into the current ones. The moved slots are
+ * marked, so the searches in the old slots skip them. When all of them were
+ * moved, the old array is released.
+ * @param this The hashmap
+ * @param steps The number of old slots to move
+ */
+void _migrate(Hashmap *const this, int steps) {
+    HashmapSlot *slot;
+
+    if (this->_old == NULL) { return; }
+
+    STATS_BEGIN(STATS_RESIZE);
+    while (steps-- > 0 && this->_migrated < this->_old_capacity) {
+        slot = &this->_old[this->_migrated++];
+
+        if (slot->_dist != 0 && slot->_dist != HASHMAP_MOVED) {
+            this->_long_probe |=
+                _place_slot(this->slots, this->_capacity, *slot);
+            memset(slot, 0, sizeof(HashmapSlot));
+            slot->_dist = HASHMAP_MOVED;
+        }
+    }
+
+    if (this->_migrated == this->_old_capacity) {
+        free(this->_old);
+        this->_old = NULL;
+        this->_old_capacity = 0;
+        this->_migrated = 0;
+    }
+    STATS_END(STATS_RESIZE, 0);
+}
 
 /**
  * @brief Checks if the hashtable should have an increased size. As we insert
- more elements in the hashtable, the chance that collisions happen increases.
- So, to keep the search times minimal, the hashtable's array will be increased
- by a factor. Setting the `HASHMAP_FILL_MAX` to 50 and `HASHMAP_EXP_FACT` to 4
- will mean that "when the number of elements stored in the hashtable is over 50%
- of the number of buckets, the size of the array will quadruple". Also, when the
- array size is increased, the key-value pairs are redistributed.
+ more elements in the hashtable, the probe sequences get longer. So, to keep
+ the search times minimal, the hashtable's array will be increased by a factor.
+ Setting the `HASHMAP_FILL_MAX` to 50 and `HASHMAP_EXP_FACT` to 4 will mean
+ that "when the number of elements stored in the hashtable is over 50% of the
+ number of slots, the size of the array will quadruple". The array is also
+ increased when an insert had to probe more than `HASHMAP_PROBE_MAX` slots, as
+ long as it has less than `HASHMAP_SPARSE_MAX` slots for every entry (a bad
+ hashing function could otherwise grow it without a limit).
+ Only the new array is allocated here. The entries are moved later (their
+ strings are not copied), `HASHMAP_MIGRATE_STEP` slots at every change, so no
+ single insert pays for the whole resize. As the new array is at least twice as
+ big, all the entries are moved long before it fills up.
  * @param this The hashmap this function is attached to
  * @return int The return code (0 for no errors)
  */
 int check_resize(Hashmap *const this) {
-    int ret_code;
+    if (this->_long_probe &&
+        this->_capacity >= this->_size * HASHMAP_SPARSE_MAX) {
+        /* The probes stay long, but the table is already sparse enough */
+        this->_long_probe = FALSE;
+    }
 
     if ((float)this->_size / (float)this->_capacity >
-        (float)HASHMAP_FILL_MAX / 100.0f) {
+            (float)HASHMAP_FILL_MAX / 100.0f ||
+        this->_long_probe) {
         /* The table needs to be increased */
-        int i;
-
         int new_capacity = this->_capacity * HASHMAP_EXP_FACT;
-        Bucket *new_buckets = calloc(new_capacity, sizeof(Bucket));
+        HashmapSlot *new_slots;
+
+        /* The previous resize must be finished first (this only happens
+         * when the probe sequences are too long) */
+        _migrate(this, this->_old_capacity);
+
+        new_slots = calloc(new_capacity, sizeof(HashmapSlot));
 
         /* Check if the malloc succeeded */
-        if (new_buckets == NULL) {
+        if (new_slots == NULL) {
             /* Mallocs failed */
             CERR(TRUE, "Couldn't resize hashmap");
             return MALLOC_ERR;
         }
 
-        /* Initialise the new buckets */
-        for (i = 0; i < new_capacity; ++i) {
-            Bucket new_bucket = INIT_PAIRLIST;
-            new_buckets[i] = new_bucket;
-        }
-
-        for (i = 0; i < this->_capacity; ++i) {
-            /* Prepare to transfer the stored values to the new bucket */
-            PairListElem *curr = this->buckets[i]._head;
-
-            while (curr != NULL) {
-                /* Compute the new hash */
-                int new_id = hash(curr->data.first) % new_capacity;
+        STATS_BEGIN(STATS_RESIZE);
 
-                /* Insert into the new buckets */
-                ret_code = new_buckets[new_id].insert(&new_buckets[new_id],
-                                                      curr->data);
+        /* The current slots become the old ones */
+        this->_old = this->slots;
+        this->_old_capacity = this->_capacity;
+        this->_migrated = 0;
+        this->_long_probe = FALSE;
 
-                if (ret_code < 0) { return ret_code; }
-
-                curr = curr->next;
-            }
-
-            /* Free the old buckets */
-            ret_code = this->buckets[i].clear(&this->buckets[i]);
-            if (ret_code < 0) { return ret_code; }
-        }
-        /* Free the allocated memory */
-        free(this->buckets);
-
-        /* Assign the new buckets to the hashmap */
-        this->buckets = new_buckets;
+        this->slots = new_slots;
         this->_capacity = new_capacity;
+
+        STATS_END(STATS_RESIZE, new_capacity * sizeof(HashmapSlot));
     }
 
     return 0;
 }
 
 int hashmap_init(Hashmap *const this) {
-    int i;
     this->_capacity = HASHMAP_SIZE_START;
     this->_size = 0;
-    this->buckets = calloc(HASHMAP_SIZE_START, sizeof(Bucket));
+    this->_long_probe = FALSE;
+    this->_old = NULL;
+    this->_old_capacity = 0;
+    this->_migrated = 0;
+    this->slots = calloc(HASHMAP_SIZE_START, sizeof(HashmapSlot));
 
-    if (this->buckets == NULL) {
+    if (this->slots == NULL) {
         CERR(TRUE, "Couldn't init hashmap");
         return MALLOC_ERR;
     }
 
-    /* Initialise all the buckets */
-    for (i = 0; i < this->_capacity; ++i) {
-        Bucket new_bucket = INIT_PAIRLIST;
-        this->buckets[i] = new_bucket;
-    }
-
     this->_is_initialised = 1;
     return 0;
 }
 
-int hashmap_put(Hashmap *const this, StringsPair pair) {
-    unsigned long id;
+/**
+ * @brief Insert a strings pair into the hashmap (see hashmap_put). The key is
+ * searched only once: if it isn't found, the search stopped where the pair
+ * must be placed.
+ * @param this The hashmap
+ * @param pair The pair to add to the hashmap (emptied, if owned)
+ * @param owned If the hashmap takes the ownership of the pair's strings
+ * @return int The return code (0 for no errors, 1 if not initialised)
+ */
+int _put(Hashmap *const this, StringsPair *pair, int owned) {
+    unsigned long h;
+    unsigned long stop;
+    unsigned int dist;
     int ret_code;
+    HashmapSlot *slot;
+    HashmapSlot entry;
 
     /* Check if the hashmap is initialised */
     if (!this->_is_initialised) {
         DEBUG_MSG("Hashmap was not initialised!");
+        if (owned) { clear_spair(pair); }
         return 1;
     }
 
+    /* Continue the resize, if there is one */
+    _migrate(this, HASHMAP_MIGRATE_STEP);
+
     /* Compute the hash */
-    id = hash(pair.first) % this->_capacity;
+    h = hash(pair->first);
+
+    /* If the key already exists, only update the value */
+    slot = _search_slot(this, pair->first, h, &stop, &dist);
+    if (slot != NULL) {
+        string value;
+
+        if (owned) {
+            value = pair->second;
+            free(pair->first);
+            pair->first = NULL;
+            pair->second = NULL;
+        } else {
+            value = calloc(strlen(pair->second) + 1, 1);
+            if (value == NULL) {
+                CERR(TRUE, "Couldn't update value in the hashmap");
+                return MALLOC_ERR;
+            }
+            strcpy(value, pair->second);
+        }
+
+        free(slot->data.second);
+        slot->data.second = value;
+        return 0;
+    }
 
     /* Insert the new pair */
-    ret_code = this->buckets[id].insert(&this->buckets[id], pair);
-    if (ret_code < 0) {
-        DEBUG_MSG("Couldn't insert pair into the list");
-        return ret_code;
+    if (owned) {
+        move_spair(pair, &entry.data);
+    } else {
+        ret_code = copy_spair(*pair, &entry.data);
+        if (ret_code < 0) {
+            DEBUG_MSG("Couldn't copy the pair into the hashmap");
+            return ret_code;
+        }
     }
 
+    entry.hash = h;
+    entry._dist = dist;
+    this->_long_probe |= _place_at(this->slots, this->_capacity, stop, entry);
     this->_size++;
 
     /* Check if a resize is needed */
@@ -199,9 +520,31 @@ int hashmap_put(Hashmap *const this, StringsPair pair) {
     return 0;
 }
 
+int hashmap_put(Hashmap *const this, StringsPair pair) {
+    int ret_code;
+
+    STATS_BEGIN(STATS_INSERT);
+    ret_code = _put(this, &pair, FALSE);
+    STATS_END(STATS_INSERT, 0);
+
+    return ret_code;
+}
+
+int hashmap_put_owned(Hashmap *const this, StringsPair *pair) {
+    int ret_code;
+
+    STATS_BEGIN(STATS_INSERT);
+    ret_code = _put(this, pair, TRUE);
+    STATS_END(STATS_INSERT, 0);
+
+    return ret_code;
+}
+
 int hashmap_remove(Hashmap *const this, string key) {
+    unsigned long mask;
     unsigned long id;
-    int ret_code;
+    unsigned long next;
+    HashmapSlot *slot;
 
     /* Check if the hashmap is initialised */
     if (!this->_is_initialised) {
@@ -209,24 +552,43 @@ int hashmap_remove(Hashmap *const this, string key) {
         return 1;
     }
 
-    /* Compute the hash */
-    id = hash(key) % this->_capacity;
+    _migrate(this, HASHMAP_MIGRATE_STEP);
 
-    /* Remove the pair from the hashmap (using the key) */
-    ret_code = this->buckets[id].remove(&this->buckets[id], key);
+    /* Find the pair in the hashmap (using the key) */
+    slot = _find_slot(this, key, hash(key));
+    if (slot == NULL) { return 0; }
 
-    if (ret_code < 0) {
-        DEBUG_MSG("Couldn't remove pair from the hashmap");
-        return ret_code;
+    clear_spair(&slot->data);
+    this->_size--;
+
+    /* The old slots can't be shifted (the unmoved entries would end up before
+     * the migration position), so the slot is only marked */
+    if (this->_old != NULL && slot >= this->_old &&
+        slot < this->_old + this->_old_capacity) {
+        memset(slot, 0, sizeof(HashmapSlot));
+        slot->_dist = HASHMAP_MOVED;
+        return 0;
     }
 
-    if (ret_code == 0) { this->_size--; }
+    /* Shift back the entries that follow it, so no "holes" are left in the
+     * probe sequences */
+    mask = (unsigned long)(this->_capacity - 1);
+    id = (unsigned long)(slot - this->slots);
+    next = (id + 1) & mask;
+    while (this->slots[next]._dist > 1) {
+        this->slots[id] = this->slots[next];
+        this->slots[id]._dist--;
+
+        id = next;
+        next = (next + 1) & mask;
+    }
+    memset(&this->slots[id], 0, sizeof(HashmapSlot));
     return 0;
 }
 
 int hashmap_get(Hashmap *const this, string key, StringsPair *pair) {
-    unsigned long id;
     int ret_code;
+    HashmapSlot *slot;
 
     /* Check if the hashmap is initialised */
     if (!this->_is_initialised) {
@@ -240,11 +602,15 @@ int hashmap_get(Hashmap *const this, string key, StringsPair *pair) {
         return 1;
     }
 
-    /* Compute the hash */
-    id = hash(key) % this->_capacity;
-
     /* Search and return the pair from the hashmap */
-    ret_code = this->buckets[id].search(&this->buckets[id], key, pair);
+    slot = _find_slot(this, key, hash(key));
+    if (slot != NULL) {
+        ret_code = copy_spair(slot->data, pair);
+    } else {
+        /* Return empty pair if the key is not found */
+        ret_code = make_spair("", "", pair);
+    }
+
     if (ret_code < 0) {
         DEBUG_MSG("Error during key search");
         return ret_code;
@@ -252,9 +618,44 @@ int hashmap_get(Hashmap *const this, string key, StringsPair *pair) {
     return 0;
 }
 
+int hashmap_find(Hashmap *const this, string key, const StringsPair **pair) {
+    return hashmap_find_hashed(this, key, hash(key), pair);
+}
+
+int hashmap_find_hashed(Hashmap *const this, string key, unsigned long h,
+                        const StringsPair **pair) {
+    HashmapSlot *slot;
+
+    *pair = NULL;
+    if (!this->_is_initialised) { return 1; }
+
+    slot = _find_slot(this, key, h);
+    if (slot == NULL) { return 1; }
+
+    *pair = &slot->data;
+    return 0;
+}
+
+int hashmap_next(Hashmap *const this, int *pos, const StringsPair **pair) {
+    HashmapSlot *slot;
+
+    /* The current slots, then the old ones (that were not moved yet) */
+    while (*pos < this->_capacity + this->_old_capacity) {
+        slot = *pos < this->_capacity ? &this->slots[*pos]
+                                      : &this->_old[*pos - this->_capacity];
+        (*pos)++;
+
+        if (slot->_dist != 0 && slot->_dist != HASHMAP_MOVED) {
+            *pair = &slot->data;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 int hashmap_clear(Hashmap *const this) {
     int i;
-    int ret_code;
 
     /* Check if the hashmap is initialised */
     if (!this->_is_initialised) {
@@ -262,23 +663,20 @@ int hashmap_clear(Hashmap *const this) {
         return 1;
     }
 
-    /* Clear all the buckets */
+    /* Free the stored pairs (the unmoved old entries are moved first) */
+    _migrate(this, this->_old_capacity);
     for (i = 0; i < this->_capacity; ++i) {
-        ret_code = this->buckets[i].clear(&this->buckets[i]);
-
-        if (ret_code < 0) {
-            DEBUG_MSG("Error during hashmap clear");
-            return ret_code;
-        }
+        if (this->slots[i]._dist != 0) { clear_spair(&this->slots[i].data); }
     }
 
     /* Free the allocated memory */
-    free(this->buckets);
+    free(this->slots);
 
     /* Set the hashmap as uninitialized */
-    this->buckets = NULL;
+    this->slots = NULL;
     this->_capacity = 0;
     this->_size = 0;
+    this->_long_probe = FALSE;
     this->_is_initialised = 0;
     return 0;
 }
@@ -295,7 +693,17 @@ int hashmap_print(Hashmap *const this) {
     printf("-- Hashmap --\n");
     for (i = 0; i < this->_capacity; ++i) {
         printf("%d - ", i);
-        this->buckets[i].print(&this->buckets[i]);
+        if (this->slots[i]._dist != 0) {
+            printf("{ %s - %s } ", this->slots[i].data.first,
+                   this->slots[i].data.second);
+        }
+        printf("\n");
+    }
+    for (i = this->_migrated; i < this->_old_capacity; ++i) {
+        if (this->_old[i]._dist != 0 && this->_old[i]._dist != HASHMAP_MOVED) {
+            printf("old %d - { %s - %s }\n", i, this->_old[i].data.first,
+                   this->_old[i].data.second);
+        }
     }
     printf("\n\n");
     return 0;
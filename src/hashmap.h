@@ -8,58 +8,175 @@
 #ifndef HASHMAP_H
 #define HASHMAP_H
 
-#include "list.h"
+#include "pair.h"
 
-#define HASHMAP_SIZE_START 16 /* Initial size */
-#define HASHMAP_FILL_MAX 50   /* Max fill percent */
-#define HASHMAP_EXP_FACT 2    /* Expansion factor */
+#define HASHMAP_SIZE_START 16 /* Initial size (must be a power of two) */
+#define HASHMAP_FILL_MAX 75   /* Max fill percent */
+#define HASHMAP_EXP_FACT 2    /* Expansion factor (must be a power of two) */
+#define HASHMAP_PROBE_MAX 32  /* Max probe length, before a forced resize */
+#define HASHMAP_SPARSE_MAX 8  /* Max slots per entry, for the forced resizes */
+#define HASHMAP_MIGRATE_STEP 64 /* Old slots moved by every change (resizes) */
+#define HASHMAP_MOVED ((unsigned int)~0U) /* The _dist of a moved old slot */
+
+/* The hashing functions (the default one can be changed at build time) */
+#define HASH_MURMUR 0
+#define HASH_DJB2 1
+#define HASH_SDBM 2
+#define HASH_PERSONAL 3
+#define HASH_FUNCTIONS 4
+
+#ifndef HASH_DEFAULT
+#define HASH_DEFAULT HASH_MURMUR
+#endif
 
 /* A "constructor" for the hashmap */
-#define INIT_HASHMAP                                                        \
-    {                                                                       \
-        0, 0, 0, 0, hashmap_init, hashmap_put, hashmap_remove, hashmap_get, \
-            hashmap_clear, hashmap_print                                    \
+#define INIT_HASHMAP                                                           \
+    {                                                                          \
+        0, 0, 0, 0, 0, 0, 0, 0, hashmap_init, hashmap_put, hashmap_put_owned,  \
+            hashmap_remove, hashmap_get, hashmap_find, hashmap_find_hashed,    \
+            hashmap_next, hashmap_clear, hashmap_print                         \
     }
 
 /**
- * @brief A bucket data structure. It stores lists of key-value pairs
+ * @brief A slot of the hashmap. The slots are stored in a contiguous array
+ * (open addressing), each one caching the full hash of its key, so most of the
+ * key comparisons can be skipped
  */
-typedef PairList Bucket;
+typedef struct HashmapSlot {
+    unsigned long hash;
+    unsigned int _dist; /* Probe distance + 1 (0 marks an empty slot) */
+    StringsPair data;
+} HashmapSlot;
 
 /**
- * @brief A hashmap data structure. It can store key/value pairs. The keys are
- * strings (char arrays), the values are integers.
+ * @brief A hashmap data structure. It can store key/value pairs. The keys and
+ * the values are strings (char arrays). Collisions are solved using linear
+ * probing, with "robin hood" insertion, to keep the probe lengths short.
+ * The resizes are incremental: the entries of the old slots are moved a few at
+ * a time, by the next changes of the hashmap, and both arrays are searched
+ * until all of them were moved.
  */
 typedef struct Hashmap {
-    Bucket *buckets;
+    HashmapSlot *slots;
     int _is_initialised;
     int _size;
     int _capacity;
+    int _long_probe; /* An insert exceeded HASHMAP_PROBE_MAX */
+    HashmapSlot *_old; /* The slots before the resize (NULL if all moved) */
+    int _old_capacity;
+    int _migrated; /* The old slots before this one were moved */
 
     int (*init)(struct Hashmap *const this);
     int (*put)(struct Hashmap *const this, StringsPair pair);
+    int (*put_owned)(struct Hashmap *const this, StringsPair *pair);
     int (*remove)(struct Hashmap *const this, string key);
     int (*get)(struct Hashmap *const this, string key, StringsPair *pair);
+    int (*find)(struct Hashmap *const this, string key,
+                const StringsPair **pair);
+    int (*find_hashed)(struct Hashmap *const this, string key,
+                       unsigned long hash, const StringsPair **pair);
+    int (*next)(struct Hashmap *const this, int *pos, const StringsPair **pair);
     int (*clear)(struct Hashmap *const this);
     int (*print)(struct Hashmap *const this);
 } Hashmap;
 
+/**
+ * @brief Select the hashing function, and its seed. It must be done before
+ * anything is hashed, as the stored hashes are not recomputed.
+ * @param name The name of the function (murmur, djb2, sdbm, personal), or NULL
+ * to keep the current one
+ * @param seed The seed
+ * @return int The return code (0 for no errors, 1 for an unknown name)
+ */
+int hash_use(const char *name, unsigned long seed);
+
+/**
+ * @brief Get the selected hashing function, and its seed
+ * @param id The id of the function (one of the HASH_* values)
+ * @param seed The seed
+ */
+void hash_config(int *id, unsigned long *seed);
+
+/**
+ * @brief Get the name of a hashing function
+ * @param id The id of the function
+ * @return const char* The name (NULL for an invalid id)
+ */
+const char *hash_name(int id);
+
+/**
+ * @brief Create a seed that is different for every run, so the inputs can't
+ * be crafted to collide
+ * @return unsigned long The seed
+ */
+unsigned long hash_random_seed(void);
+
+/**
+ * @brief Hash a span of characters, with a specific hashing function
+ * @param id The id of the function
+ * @param seed The seed
+ * @param src The start of the span
+ * @param len The length of the span
+ * @return unsigned long The hash
+ */
+unsigned long hash_span_with(int id, unsigned long seed, const char *src,
+                             size_t len);
+
+/**
+ * @brief Hash a span of characters. This is a wrapper function, that uses the
+ * selected hashing function (see hash_use)
+ * @param src The start of the span
+ * @param len The length of the span
+ * @return unsigned long The hash
+ */
+unsigned long hash_span(const char *src, size_t len);
+
+/**
+ * @brief Hash a string (see hash_span)
+ * @param src The string to hash
+ * @return unsigned long The hash
+ */
+unsigned long hash(string src);
+
+/**
+ * @brief Compute the "home" slot of a hash, in a table with a power of two
+ * slots. The hash is mixed before masking it, as only its low bits would be
+ * used otherwise (which, for weak hashing functions, are badly distributed).
+ * All the tables probe from this slot, so they share the same sequences.
+ * @param hash The full hash of the key
+ * @param capacity The number of slots (a power of two)
+ * @return unsigned long The slot index
+ */
+unsigned long hash_slot(unsigned long hash, unsigned long capacity);
+
 /**
  * @brief Initialise the hashmap, if it isn't initialised (allocating space for
- * the buckets, etc..)
+ * the slots, etc..)
  * @param this The hashmap this function is attached to
  * @return int The return code (0 for no errors)
  */
 int hashmap_init(Hashmap *const this);
 
 /**
- * @brief Insert a strings pair into the hashmap
+ * @brief Insert a strings pair into the hashmap. If the key already exists,
+ * update the value
  * @param this The hashmap this function is attached to
  * @param pair The pair to add to the hashmap
  * @return int The return code (0 for no errors, 1 if not initialised)
  */
 int hashmap_put(Hashmap *const this, StringsPair pair);
 
+/**
+ * @brief Insert an already allocated strings pair into the hashmap, without
+ * copying it. If the key already exists, only the value is replaced (and the
+ * new key is freed). The hashmap takes the ownership of the strings even if the
+ * insert fails, and the pair is emptied.
+ * @param this The hashmap this function is attached to
+ * @param pair The pair to move into the hashmap (pointer)
+ * @return int The return code (0 for no errors, 1 if not initialised)
+ */
+int hashmap_put_owned(Hashmap *const this, StringsPair *pair);
+
 /**
  * @brief Remove a strings pair from the hashmap
  * @param this The hashmap this function is attached to
@@ -78,6 +195,41 @@ int hashmap_remove(Hashmap *const this, string key);
  */
 int hashmap_get(Hashmap *const this, string key, StringsPair *pair);
 
+/**
+ * @brief Search for a strings pair in the hashmap, without copying it. The
+ * returned pair is owned by the hashmap, and it is valid only until the next
+ * change of the hashmap.
+ * @param this The hashmap this function is attached to
+ * @param key The key of the searched pair
+ * @param pair The (read-only) pair with the required key. Set to NULL if the
+ * key is not found
+ * @return int The return code (0 if the key was found, 1 if not)
+ */
+int hashmap_find(Hashmap *const this, string key, const StringsPair **pair);
+
+/**
+ * @brief Search for a strings pair in the hashmap, without copying it, when
+ * the hash of the key is already known (see hashmap_find)
+ * @param this The hashmap this function is attached to
+ * @param key The key of the searched pair
+ * @param hash The hash of the key (computed with hash_span)
+ * @param pair The (read-only) pair with the required key. Set to NULL if the
+ * key is not found
+ * @return int The return code (0 if the key was found, 1 if not)
+ */
+int hashmap_find_hashed(Hashmap *const this, string key, unsigned long hash,
+                        const StringsPair **pair);
+
+/**
+ * @brief Iterate over the pairs of the hashmap (in no particular order). The
+ * hashmap must not be modified during the iteration.
+ * @param this The hashmap this function is attached to
+ * @param pos The position of the iteration (must start from 0)
+ * @param pair The next pair (borrowed)
+ * @return int The return code (0 for a pair, 1 at the end)
+ */
+int hashmap_next(Hashmap *const this, int *pos, const StringsPair **pair);
+
 /**
  * @brief Clear all values from the hashmap (and sort of "un-initialise" it)
  * @param this The hashmap this function is attached to
@@ -0,0 +1,321 @@
+/**
+ * @file headers.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the headers cache
+ * @copyright Copyright (c) 2021
+ */
+
+#include "headers.h"
+
+#include "lexer.h"
+
+/**
+ * @brief Check if a line is blank (only spaces, tabs and the line end)
+ * @param line The line (not null-terminated)
+ * @param len The length of the line
+ * @return int TRUE if the line is blank, FALSE otherwise
+ */
+int _is_blank(const char *line, size_t len) {
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        if (line[i] != ' ' && line[i] != '\t' && line[i] != '\n' &&
+            line[i] != '\r') {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @brief Check if a directive is "#pragma once". The lexer doesn't know
+ * "pragma", so its name is checked here.
+ * @param line The directive line (not null-terminated)
+ * @param directive The directive, as it was split by the lexer
+ * @return int TRUE if it is "#pragma once", FALSE otherwise
+ */
+int _is_pragma_once(const char *line, const Directive *directive) {
+    if (directive->kind != DIRECTIVE_UNKNOWN) { return FALSE; }
+
+    /* The name and the arguments are compared in place */
+    return directive->name_len == 6 &&
+           strncmp(line + directive->name, "pragma", 6) == 0 &&
+           directive->args_len == 4 &&
+           strncmp(line + directive->args, "once", 4) == 0;
+}
+
+/**
+ * @brief Find the include guards of a header. The header is guarded if it
+ * starts with "#ifndef X", and the matching "#endif" is its last line (only
+ * blank lines can be outside them, and the block has no "#else"/"#elif").
+ * The lines are split by the same lexer as the processed ones, so only the
+ * directives that the preprocessor sees are taken into account, and the guard
+ * is the exact argument that its "#ifndef" checks.
+ * @param header The header
+ * @return int The return code
+ */
+int _detect_guard(Header *const header) {
+    InputReader view;
+    Directive directive;
+    const char *line;
+    const char *guard = NULL;
+    size_t len;
+    size_t guard_len = 0;
+    int depth = 0;
+    int seen_first = FALSE; /* A non-blank line was found */
+    int closed = FALSE;     /* The guard block was closed */
+    int valid = TRUE;
+    int ret_code;
+
+    header->content.view(&header->content, &view);
+
+    while ((ret_code = view.next_line(&view, &line, &len)) == 1) {
+        if (_is_blank(line, len)) { continue; }
+        lexer_directive(line, len, &directive);
+
+        if (_is_pragma_once(line, &directive)) { header->once = TRUE; }
+
+        if (closed) {
+            /* Something after the end of the guard */
+            valid = FALSE;
+            continue;
+        }
+
+        if (!seen_first) {
+            seen_first = TRUE;
+
+            if (directive.kind == DIRECTIVE_IFNDEF && directive.args_len != 0) {
+                guard = line + directive.args;
+                guard_len = directive.args_len;
+                depth = 1;
+            } else {
+                valid = FALSE;
+            }
+            continue;
+        }
+
+        if (!valid) { continue; }
+
+        if (IS_IF_DIRECTIVE(directive.kind)) {
+            depth++;
+        } else if (directive.kind == DIRECTIVE_ENDIF) {
+            depth--;
+            if (depth == 0) { closed = TRUE; }
+        } else if (depth == 1 && (directive.kind == DIRECTIVE_ELSE ||
+                                  directive.kind == DIRECTIVE_ELIF)) {
+            valid = FALSE;
+        }
+    }
+
+    view.close(&view);
+    if (ret_code < 0) { return ret_code; }
+
+    if (valid && closed && guard != NULL) {
+        header->guard = calloc(guard_len + 1, 1);
+        if (header->guard == NULL) {
+            CERR(TRUE, "Couldn't allocate memory");
+            return MALLOC_ERR;
+        }
+        memcpy(header->guard, guard, guard_len);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Add a header to the index (there must be a free slot)
+ * @param this The cache
+ * @param header The header
+ */
+void _index_header(HeaderCache *const this, Header *header) {
+    int mask = this->_index_cap - 1;
+    int slot = (int)(header->hash & mask);
+
+    while (this->_index[slot] != NULL) { slot = (slot + 1) & mask; }
+    this->_index[slot] = header;
+}
+
+/**
+ * @brief Build the index again, with a new capacity (a power of 2)
+ * @param this The cache
+ * @param capacity The number of slots
+ * @return int The return code
+ */
+int _rebuild_index(HeaderCache *const this, int capacity) {
+    Header **aux_buff = calloc(capacity, sizeof(Header *));
+    int i;
+
+    if (aux_buff == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the headers index");
+        return MALLOC_ERR;
+    }
+
+    free(this->_index);
+    this->_index = aux_buff;
+    this->_index_cap = capacity;
+
+    for (i = 0; i < this->_size; ++i) {
+        _index_header(this, this->_headers[i]);
+    }
+    return 0;
+}
+
+int headercache_find(HeaderCache *const this, string path, Header **header) {
+    unsigned long h;
+    int mask;
+    int slot;
+
+    *header = NULL;
+    if (this->_index_cap == 0) { return 1; }
+
+    h = hash(path);
+    mask = this->_index_cap - 1;
+    slot = (int)(h & mask);
+
+    /* The index is at most half full, so the probing stops quickly */
+    while (this->_index[slot] != NULL) {
+        if (this->_index[slot]->hash == h &&
+            strcmp(this->_index[slot]->path, path) == 0) {
+            *header = this->_index[slot];
+            return 0;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return 1;
+}
+
+int headercache_load(HeaderCache *const this, string path, Header **header) {
+    InputReader new_content = INIT_READER;
+    Header *new_header;
+    FILE *file;
+    int ret_code;
+
+    if (this->find(this, path, header) == 0) { return 0; }
+
+    /* Make space for the new header */
+    if (this->_size == this->_capacity) {
+        int new_capacity =
+            this->_capacity == 0 ? HEADERS_SIZE_START : this->_capacity * 2;
+        Header **aux_buff =
+            realloc(this->_headers, new_capacity * sizeof(Header *));
+
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the headers");
+            return MALLOC_ERR;
+        }
+        this->_headers = aux_buff;
+        this->_capacity = new_capacity;
+    }
+
+    if ((this->_size + 1) * 2 > this->_index_cap) {
+        ret_code = _rebuild_index(this, this->_index_cap == 0
+                                            ? HEADERS_SIZE_START * 2
+                                            : this->_index_cap * 2);
+        if (ret_code != 0) { return ret_code; }
+    }
+
+    new_header = calloc(1, sizeof(Header));
+    if (new_header == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the header");
+        return MALLOC_ERR;
+    }
+
+    new_header->path = calloc(strlen(path) + 1, 1);
+    if (new_header->path == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the header");
+        free(new_header);
+        return MALLOC_ERR;
+    }
+    strcpy(new_header->path, path);
+    new_header->hash = hash(path);
+    new_header->content = new_content;
+
+    /* Read the file */
+    file = fopen(path, "r");
+    if (file == NULL) {
+        free(new_header->path);
+        free(new_header);
+        return 1;
+    }
+
+    /* The headers are kept between the requests of the server, and they
+     * could be truncated meanwhile, so the small ones are copied */
+    stamp_path(path, &new_header->stamp);
+    if (new_header->stamp.size <= HEADERS_COPY_MAX) {
+        ret_code = new_header->content.open_copy(&new_header->content, file);
+    } else {
+        ret_code = new_header->content.open(&new_header->content, file);
+    }
+    fclose(file);
+
+    if (ret_code == 0) { ret_code = _detect_guard(new_header); }
+    if (ret_code != 0) {
+        new_header->content.close(&new_header->content);
+        free(new_header->guard);
+        free(new_header->path);
+        free(new_header);
+        return ret_code;
+    }
+
+    this->_headers[this->_size++] = new_header;
+    _index_header(this, new_header);
+    *header = new_header;
+    return 0;
+}
+
+int headercache_reset(HeaderCache *const this) {
+    int i;
+
+    for (i = 0; i < this->_size; ++i) { this->_headers[i]->included = FALSE; }
+    return 0;
+}
+
+/**
+ * @brief Release a header
+ * @param header The header
+ */
+void _free_header(Header *header) {
+    header->content.close(&header->content);
+    free(header->guard);
+    free(header->path);
+    free(header);
+}
+
+int headercache_revalidate(HeaderCache *const this) {
+    FileStamp stamp;
+    int removed = FALSE;
+    int i = 0;
+
+    while (i < this->_size) {
+        stamp_path(this->_headers[i]->path, &stamp);
+
+        if (stamp_equal(&stamp, &this->_headers[i]->stamp)) {
+            i++;
+        } else {
+            /* The last header takes its place */
+            _free_header(this->_headers[i]);
+            this->_headers[i] = this->_headers[--this->_size];
+            removed = TRUE;
+        }
+    }
+
+    /* The removed headers leave holes in the probe sequences */
+    if (removed) { return _rebuild_index(this, this->_index_cap); }
+    return 0;
+}
+
+int headercache_clear(HeaderCache *const this) {
+    int i;
+
+    for (i = 0; i < this->_size; ++i) { _free_header(this->_headers[i]); }
+    free(this->_headers);
+    free(this->_index);
+
+    this->_headers = NULL;
+    this->_size = 0;
+    this->_capacity = 0;
+    this->_index = NULL;
+    this->_index_cap = 0;
+    return 0;
+}
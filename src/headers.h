@@ -0,0 +1,102 @@
+/**
+ * @file headers.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the headers cache
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef HEADERS_H
+#define HEADERS_H
+
+#include "hashmap.h"
+#include "reader.h"
+#include "stamp.h"
+
+#define HEADERS_SIZE_START 16 /* Initial size */
+#define HEADERS_COPY_MAX (1L << 20) /* Bigger headers are mapped, not copied */
+
+/* A "constructor" for the headers cache */
+#define INIT_HEADERCACHE                                          \
+    {                                                             \
+        0, 0, 0, 0, 0, headercache_find, headercache_load,        \
+            headercache_reset, headercache_revalidate,            \
+            headercache_clear                                     \
+    }
+
+/**
+ * @brief A header file that was read. Its content is kept for the whole run,
+ * so it is read only once, no matter how many times it is included.
+ */
+typedef struct Header {
+    string path;
+    unsigned long hash; /* The hash of the path */
+    InputReader content;
+    FileStamp stamp; /* The version of the file that was read */
+    string guard; /* The include guard macro (NULL if the header has none) */
+    int once;     /* The header contains "#pragma once" */
+    int included; /* The header was included at least once */
+} Header;
+
+/**
+ * @brief The cache of the read headers, searched by path. The headers are
+ * indexed by the hash of their path (open addressing, at most half full), so
+ * an include doesn't depend on the number of read headers.
+ */
+typedef struct HeaderCache {
+    Header **_headers;
+    int _size;
+    int _capacity;
+    Header **_index; /* The slots of the index (NULL for free slots) */
+    int _index_cap;  /* The number of slots (a power of 2) */
+
+    int (*find)(struct HeaderCache *const this, string path, Header **header);
+    int (*load)(struct HeaderCache *const this, string path, Header **header);
+    int (*reset)(struct HeaderCache *const this);
+    int (*revalidate)(struct HeaderCache *const this);
+    int (*clear)(struct HeaderCache *const this);
+} HeaderCache;
+
+/**
+ * @brief Search for a header that was already read
+ * @param this The cache this function is attached to
+ * @param path The path of the header
+ * @param header The header (NULL if it is not in the cache)
+ * @return int The return code (0 if the header was found, 1 if not)
+ */
+int headercache_find(HeaderCache *const this, string path, Header **header);
+
+/**
+ * @brief Get a header from the cache. If it is not there, the file is read
+ * and checked for include guards (the "#ifndef X ... #endif" pattern around
+ * the whole file, or "#pragma once")
+ * @param this The cache this function is attached to
+ * @param path The path of the header
+ * @param header The header
+ * @return int The return code (0 for no errors, 1 if the file can't be read)
+ */
+int headercache_load(HeaderCache *const this, string path, Header **header);
+
+/**
+ * @brief Mark all the headers as not included, so they can be used for a new
+ * input (their content is kept)
+ * @param this The cache this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int headercache_reset(HeaderCache *const this);
+
+/**
+ * @brief Drop the headers whose files were modified, replaced or removed since
+ * they were read (they are read again when they are included)
+ * @param this The cache this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int headercache_revalidate(HeaderCache *const this);
+
+/**
+ * @brief Release all the headers
+ * @param this The cache this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int headercache_clear(HeaderCache *const this);
+
+#endif
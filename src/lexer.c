@@ -0,0 +1,128 @@
+/**
+ * @file lexer.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the line lexer. The runs of delimiters and the
+ * identifiers are found with the scanner, the other tokens are classified by
+ * their first character.
+ * @copyright Copyright (c) 2021
+ */
+
+#include "lexer.h"
+
+#include "stats.h"
+
+/* The directive names (without '#'), in the order of their kinds */
+const char *const _directive_names[] = {
+    "define", "undef", "include", "if", "ifdef", "ifndef", "elif", "else",
+    "endif"};
+
+void lexer_start(Lexer *const this, const char *data, size_t len) {
+    this->_data = data;
+    this->_len = len;
+    this->_pos = 0;
+}
+
+/**
+ * @brief Find the end of a string or character literal
+ * @param data The start of the literal (its opening quote)
+ * @param len The length of the span
+ * @return size_t The length of the literal (1 if it isn't closed on the line,
+ * so only the quote is taken)
+ */
+size_t _lexer_literal(const char *data, size_t len) {
+    size_t i = 1;
+
+    while (i < len && data[i] != data[0] && data[i] != '\n') {
+        /* An escaped character can't close the literal */
+        if (data[i] == '\\' && i + 1 < len) { i++; }
+        i++;
+    }
+
+    return i < len && data[i] == data[0] ? i + 1 : 1;
+}
+
+int lexer_next(Lexer *const this, Token *token) {
+    const char *data = this->_data + this->_pos;
+    size_t left = this->_len - this->_pos;
+    size_t len = 1;
+    uchar first;
+
+    if (left == 0) { return 0; }
+
+    STATS_BEGIN(STATS_SCAN);
+    token->start = this->_pos;
+    first = (uchar)data[0];
+
+    if (IS_DELIM(first)) {
+        token->kind = TOKEN_DELIMS;
+        len = scan_word(data, left);
+    } else if (IS_IDENT(first)) {
+        /* The identifiers and the numbers end at the first character that
+         * can't be part of them (a delimiter, a quote, the newline...) */
+        token->kind = first >= '0' && first <= '9' ? TOKEN_NUMBER : TOKEN_IDENT;
+        len = scan_ident(data, left);
+    } else {
+        /* The literals are taken whole, so the words inside them are not
+         * expanded. The other characters are taken up to the next token. */
+        token->kind = TOKEN_OTHER;
+        if (first == '"' || first == '\'') {
+            len = _lexer_literal(data, left);
+        } else {
+            while (len < left && !IS_DELIM(data[len]) &&
+                   !IS_IDENT(data[len]) && data[len] != '"' &&
+                   data[len] != '\'') {
+                len++;
+            }
+        }
+    }
+    token->len = len;
+    STATS_END(STATS_SCAN, token->len);
+
+    this->_pos += token->len;
+    return 1;
+}
+
+int lexer_directive(const char *data, size_t len, Directive *directive) {
+    size_t pos = 0;
+    size_t name;
+    size_t end;
+    int i;
+
+    directive->kind = DIRECTIVE_NONE;
+    directive->name = len;
+    directive->name_len = 0;
+    directive->args = len;
+    directive->args_len = 0;
+
+    while (pos < len && (data[pos] == ' ' || data[pos] == '\t')) { pos++; }
+    if (pos == len || data[pos] != '#') { return FALSE; }
+
+    /* The name ends at the first blank */
+    name = ++pos;
+    while (pos < len && data[pos] != ' ' && data[pos] != '\t' &&
+           data[pos] != '\n' && data[pos] != '\r') {
+        pos++;
+    }
+    directive->name = name;
+    directive->name_len = pos - name;
+
+    directive->kind = DIRECTIVE_UNKNOWN;
+    for (i = 0; i < DIRECTIVE_ENDIF - DIRECTIVE_DEFINE + 1; ++i) {
+        if (strlen(_directive_names[i]) == pos - name &&
+            memcmp(data + name, _directive_names[i], pos - name) == 0) {
+            directive->kind = DIRECTIVE_DEFINE + i;
+            break;
+        }
+    }
+
+    /* The arguments */
+    while (pos < len && (data[pos] == ' ' || data[pos] == '\t')) { pos++; }
+    end = len;
+    while (end > pos && (data[end - 1] == '\n' || data[end - 1] == '\r')) {
+        end--;
+    }
+
+    directive->args = pos;
+    directive->args_len = end - pos;
+    return TRUE;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file lexer.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the line lexer
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "scanner.h"
+
+/* A "constructor" for the lexer */
+#define INIT_LEXER \
+    { 0, 0, 0 }
+
+/* The kinds of tokens */
+#define TOKEN_DELIMS 0 /* A run of delimiters, written as it is */
+#define TOKEN_IDENT 1  /* An identifier ([A-Za-z_][A-Za-z0-9_]*) */
+#define TOKEN_NUMBER 2 /* A number ([0-9][A-Za-z0-9_]*) */
+#define TOKEN_OTHER 3  /* A string or char literal, or other characters */
+
+/* The kinds of directives */
+#define DIRECTIVE_NONE 0 /* The line is not a directive */
+#define DIRECTIVE_UNKNOWN 1
+#define DIRECTIVE_DEFINE 2
+#define DIRECTIVE_UNDEF 3
+#define DIRECTIVE_INCLUDE 4
+#define DIRECTIVE_IF 5
+#define DIRECTIVE_IFDEF 6
+#define DIRECTIVE_IFNDEF 7
+#define DIRECTIVE_ELIF 8
+#define DIRECTIVE_ELSE 9
+#define DIRECTIVE_ENDIF 10
+
+/* Check if a directive opens a conditional block */
+#define IS_IF_DIRECTIVE(kind) \
+    ((kind) >= DIRECTIVE_IF && (kind) <= DIRECTIVE_IFNDEF)
+
+/**
+ * @brief A token of a line. It is a span of the line, so nothing is copied.
+ */
+typedef struct Token {
+    int kind;
+    size_t start; /* The offset of the token in the line */
+    size_t len;
+} Token;
+
+/**
+ * @brief A directive line, split into its kind, its name and its arguments
+ */
+typedef struct Directive {
+    int kind;
+    size_t name;     /* The offset of the name in the line (after the '#') */
+    size_t name_len; /* The length of the name (0 if the line has none) */
+    size_t args;     /* The offset of the arguments in the line */
+    size_t args_len; /* The length of the arguments (0 if there are none) */
+} Directive;
+
+/**
+ * @brief A lexer, that walks a line once, splitting it into tokens. The
+ * delimiters are the ones of the scanner. The identifiers end at the first
+ * character that can't be part of them, and the literals are single tokens.
+ */
+typedef struct Lexer {
+    const char *_data;
+    size_t _len;
+    size_t _pos;
+} Lexer;
+
+/**
+ * @brief Start lexing a line
+ * @param this The lexer
+ * @param data The line (it doesn't have to be null-terminated)
+ * @param len The length of the line
+ */
+void lexer_start(Lexer *const this, const char *data, size_t len);
+
+/**
+ * @brief Get the next token of the line
+ * @param this The lexer
+ * @param token The token
+ * @return int 1 if a token was found, 0 at the end of the line
+ */
+int lexer_next(Lexer *const this, Token *token);
+
+/**
+ * @brief Check if a line is a directive. A directive starts with '#' (only
+ * blanks can be before it), followed directly by its name. The arguments are
+ * the rest of the line, without the leading blanks and the newline.
+ * @param data The line (it doesn't have to be null-terminated)
+ * @param len The length of the line
+ * @param directive The directive (its kind is DIRECTIVE_NONE for the other
+ * lines)
+ * @return int TRUE if the line is a directive, FALSE otherwise
+ */
+int lexer_directive(const char *data, size_t len, Directive *directive);
+
+#endif
@@ -10,27 +10,29 @@
 
 #include "list.h"
 
-int pairlist_search(PairList *const this, string key, StringsPair *pair) {
+int pairlist_find(PairList *const this, string key, const StringsPair **pair) {
     PairListElem *curr = this->_head;
-    int ret_code;
-
-    if (this->_size == 0) {
-        /* Return empty pair if the key is not found (empty list) */
-        ret_code = make_spair("", "", pair);
-        if (ret_code < 0) {
-            DEBUG_MSG("Error while searching for a pair in the list");
-            return ret_code;
-        }
-        return 1;
-    }
 
     while (curr != NULL) {
         if (strcmp(curr->data.first, key) == 0) {
-            return copy_spair(curr->data, pair);
+            *pair = &curr->data;
+            return 0;
         }
         curr = curr->next;
     }
 
+    *pair = NULL;
+    return 1;
+}
+
+int pairlist_search(PairList *const this, string key, StringsPair *pair) {
+    const StringsPair *found;
+    int ret_code;
+
+    if (this->find(this, key, &found) == 0) {
+        return copy_spair(*found, pair);
+    }
+
     /* Return empty pair if the key is not found */
     ret_code = make_spair("", "", pair);
     if (ret_code < -1) {
@@ -41,46 +43,55 @@ int pairlist_search(PairList *const this, string key, StringsPair *pair) {
 }
 
 int pairlist_push_back(PairList *const this, StringsPair pair) {
-    PairListElem *new_node = calloc(1, sizeof(PairListElem));
-    PairListElem *curr = this->_head;
+    StringsPair copy;
     int ret_code;
 
-    if (new_node == NULL) {
-        DEBUG_MSG("Error while creating a new node to push");
-        return MALLOC_ERR;
-    }
-
-    ret_code = copy_spair(pair, &new_node->data);
+    ret_code = copy_spair(pair, &copy);
     if (ret_code < 0) {
         DEBUG_MSG("Error while pushing a pair to the list");
         return ret_code;
     }
 
-    new_node->next = NULL;
-    new_node->prev = NULL;
+    return this->insert_owned(this, &copy);
+}
 
-    /* If the list is empty, add the node directly */
-    if (this->_size == 0) {
-        this->_head = new_node;
-        this->_size++;
-        return 0;
+int pairlist_insert_owned(PairList *const this, StringsPair *pair) {
+    PairListElem *new_node;
+    PairListElem *curr = this->_head;
+    PairListElem *last = NULL;
+
+    /* A single walk: update the value, or stop at the last node */
+    while (curr != NULL) {
+        if (strcmp(curr->data.first, pair->first) == 0) {
+            free(curr->data.second);
+            curr->data.second = pair->second;
+            free(pair->first);
+            pair->first = NULL;
+            pair->second = NULL;
+            return 0;
+        }
+        last = curr;
+        curr = curr->next;
     }
 
-    /* Remove the node with the same key (to avoid duplicates/update value) */
-    ret_code = this->remove(this, pair.first);
+    new_node = calloc(1, sizeof(PairListElem));
+    if (new_node == NULL) {
+        DEBUG_MSG("Error while creating a new node to push");
+        clear_spair(pair);
+        return MALLOC_ERR;
+    }
 
-    /* Check again the list size */
-    if (this->_size == 0) {
+    move_spair(pair, &new_node->data);
+    new_node->next = NULL;
+    new_node->prev = last;
+
+    /* If the list is empty, add the node directly */
+    if (last == NULL) {
         this->_head = new_node;
-        this->_size++;
-        return 0;
+    } else {
+        last->next = new_node;
     }
 
-    while (curr->next != NULL) { curr = curr->next; }
-
-    /* The next is empty, so insert the new value there */
-    curr->next = new_node;
-    new_node->prev = curr;
     this->_size++;
     return 0;
 }
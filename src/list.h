@@ -13,8 +13,9 @@
 /* A "constructor" for the list */
 #define INIT_PAIRLIST                                               \
     {                                                               \
-        0, 0, pairlist_search, pairlist_push_back, pairlist_remove, \
-            pairlist_clear, pairlist_print                          \
+        0, 0, pairlist_search, pairlist_find, pairlist_push_back,   \
+            pairlist_insert_owned, pairlist_remove, pairlist_clear, \
+            pairlist_print                                          \
     }
 
 typedef struct PairListElem {
@@ -28,7 +29,10 @@ typedef struct PairList {
     int _size;
 
     int (*search)(struct PairList *const this, string key, StringsPair *pair);
+    int (*find)(struct PairList *const this, string key,
+                const StringsPair **pair);
     int (*insert)(struct PairList *const this, StringsPair pair);
+    int (*insert_owned)(struct PairList *const this, StringsPair *pair);
     int (*remove)(struct PairList *const this, string key);
     int (*clear)(struct PairList *const this);
     int (*print)(struct PairList *const this);
@@ -45,6 +49,18 @@ typedef struct PairList {
  */
 int pairlist_search(PairList *const this, string key, StringsPair *pair);
 
+/**
+ * @brief Search for a strings pair in the list, without copying it. The
+ * returned pair is owned by the list, and it is valid only until the next
+ * change of the list.
+ * @param this The list this function is attached to
+ * @param key The key of the searched pair
+ * @param pair The (read-only) pair with the required key. Set to NULL if the
+ * key is not found
+ * @return int The return code (0 if the key was found, 1 if not)
+ */
+int pairlist_find(PairList *const this, string key, const StringsPair **pair);
+
 /**
  * @brief Insert a pair at the back of the list. If the key already exists,
  * update the value
@@ -54,6 +70,17 @@ int pairlist_search(PairList *const this, string key, StringsPair *pair);
  */
 int pairlist_push_back(PairList *const this, StringsPair pair);
 
+/**
+ * @brief Insert an already allocated pair at the back of the list, without
+ * copying it. If the key already exists, only the value is replaced (and the
+ * new key is freed). The list takes the ownership of the strings even if the
+ * insert fails, and the pair is emptied.
+ * @param this The list this function is attached to
+ * @param pair The pair to move into the list (pointer)
+ * @return int The return code (0 for no errors)
+ */
+int pairlist_insert_owned(PairList *const this, StringsPair *pair);
+
 /**
  * @brief Remove a pair from the list
  * @param this The list this function is attached to
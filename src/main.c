@@ -9,6 +9,8 @@
 
 int process_ret_code(int ret_code) {
     if (ret_code == MALLOC_ERR) { return -MALLOC_ERR; }
+    if (ret_code == IO_ERR) { return -IO_ERR; }
+    if (ret_code == FILE_ERR) { return -FILE_ERR; }
 
     return 0;
 }
@@ -8,29 +8,32 @@
 #include "pair.h"
 
 int make_spair(string first, string second, StringsPair *pair) {
-    pair->first = strcpy(calloc(1, strlen(first) + 1), first);
-    pair->second = strcpy(calloc(1, strlen(second) + 1), second);
+    pair->first = calloc(1, strlen(first) + 1);
+    pair->second = calloc(1, strlen(second) + 1);
 
     if (pair->first == NULL || pair->second == NULL) {
         /* Mallocs failed */
+        free(pair->first);
+        free(pair->second);
+        pair->first = NULL;
+        pair->second = NULL;
         CERR(TRUE, "Couldn't create pair");
         return MALLOC_ERR;
     }
+
+    strcpy(pair->first, first);
+    strcpy(pair->second, second);
     return 0;
 }
 
 int copy_spair(StringsPair source, StringsPair *target) {
-    target->first = strcpy(calloc(1, strlen(source.first) + 1), source.first);
-    target->second =
-        strcpy(calloc(1, strlen(source.second) + 1), source.second);
-
-    if (target->first == NULL || target->second == NULL) {
-        /* Mallocs failed */
-        CERR(TRUE, "Couldn't create pair");
-        return MALLOC_ERR;
-    }
+    return make_spair(source.first, source.second, target);
+}
 
-    return 0;
+void move_spair(StringsPair *source, StringsPair *target) {
+    *target = *source;
+    source->first = NULL;
+    source->second = NULL;
 }
 
 int clear_spair(StringsPair *p) {
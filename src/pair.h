@@ -38,6 +38,14 @@ int make_spair(string s1, string s2, StringsPair *pair);
  */
 int copy_spair(StringsPair source, StringsPair *target);
 
+/**
+ * @brief Move the strings of a pair into another, without copying them. The
+ * source pair is emptied (NULL strings).
+ * @param source The source pair (pointer)
+ * @param target The target pair (pointer)
+ */
+void move_spair(StringsPair *source, StringsPair *target);
+
 /**
  * @brief Free strings inside a pair
  * @param p The pair (pointer)
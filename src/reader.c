@@ -0,0 +1,291 @@
+/**
+ * @file reader.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the input reader
+ * @copyright Copyright (c) 2021
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#define READER_USE_MMAP
+#endif
+
+#include "reader.h"
+
+#include "stats.h"
+
+#ifdef READER_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+ * @brief Try to memory-map the input (only works for regular files)
+ * @param this The reader
+ * @param input The input FILE
+ * @return int 0 if the file was mapped, 1 otherwise
+ */
+int _map_input(InputReader *const this, FILE *input) {
+#ifdef READER_USE_MMAP
+    struct stat st;
+    void *data;
+    int fd = fileno(input);
+
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size <= 0) {
+        return 1;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) { return 1; }
+
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    this->_data = data;
+    this->_size = (size_t)st.st_size;
+    this->_is_mapped = TRUE;
+    return 0;
+#else
+    (void)this;
+    (void)input;
+    return 1;
+#endif
+}
+
+/**
+ * @brief Read the whole input into a buffer, in large chunks
+ * @param this The reader
+ * @param input The input FILE
+ * @return int The return code
+ */
+int _buffer_input(InputReader *const this, FILE *input) {
+    size_t capacity = 0;
+    size_t read_size;
+    string aux_buff;
+
+    do {
+        if (capacity - this->_size < READER_CHUNK_SIZE) {
+            capacity = capacity == 0 ? READER_CHUNK_SIZE : capacity * 2;
+
+            aux_buff = realloc(this->_data, capacity);
+            if (aux_buff == NULL) {
+                CERR(TRUE, "Couldn't allocate memory for the input");
+                free(this->_data);
+                this->_data = NULL;
+                this->_size = 0;
+                return MALLOC_ERR;
+            }
+            this->_data = aux_buff;
+        }
+
+        read_size =
+            fread(this->_data + this->_size, 1, capacity - this->_size, input);
+        this->_size += read_size;
+    } while (read_size != 0);
+
+    /* The buffer is freed by close, even if the input couldn't be read */
+    this->_is_mapped = FALSE;
+
+    if (ferror(input)) {
+        CERR(TRUE, "Couldn't read the input");
+        return IO_ERR;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Append a piece of a continued line to the splice buffer
+ * @param this The reader
+ * @param used The number of bytes already in the splice buffer
+ * @param piece The start of the piece
+ * @param len The length of the piece
+ * @return int The return code
+ */
+int _splice_piece(InputReader *const this, size_t used, const char *piece,
+                  size_t len) {
+    if (used + len > this->_splice_cap) {
+        size_t new_cap = this->_splice_cap == 0 ? 256 : this->_splice_cap;
+        string aux_buff;
+
+        while (new_cap < used + len) { new_cap *= 2; }
+
+        aux_buff = realloc(this->_splice, new_cap);
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the line");
+            return MALLOC_ERR;
+        }
+        this->_splice = aux_buff;
+        this->_splice_cap = new_cap;
+    }
+
+    memcpy(this->_splice + used, piece, len);
+    return 0;
+}
+
+int reader_open(InputReader *const this, FILE *input) {
+    this->_pos = 0;
+    this->_is_owner = TRUE;
+
+    if (_map_input(this, input) == 0) { return 0; }
+    return _buffer_input(this, input);
+}
+
+int reader_open_copy(InputReader *const this, FILE *input) {
+    this->_pos = 0;
+    this->_is_owner = TRUE;
+
+    return _buffer_input(this, input);
+}
+
+int reader_view(InputReader *const this, InputReader *view) {
+    *view = *this;
+    view->_pos = 0;
+    view->_is_owner = FALSE;
+    view->_splice = NULL;
+    view->_splice_cap = 0;
+    return 0;
+}
+
+/**
+ * @brief Get the next line of the input (see reader_next_line)
+ * @param this The reader
+ * @param line The start of the line
+ * @param len The length of the line
+ * @return int The return code (0 for EOF, 1 for Success, others for errors)
+ */
+int _next_line(InputReader *const this, const char **line, size_t *len) {
+    const char *start = this->_data + this->_pos;
+    const char *end = this->_data + this->_size;
+    const char *line_end;
+    size_t used = 0;
+    int had_multi = FALSE;
+    int ret_code;
+
+    if (start >= end) { return 0; }
+
+    while (start < end) {
+        line_end = memchr(start, '\n', end - start);
+        line_end = line_end == NULL ? end : line_end + 1;
+
+        if (line_end - start > 1 && line_end[-1] == '\n' &&
+            line_end[-2] == '\\') {
+            /* Line must be continued. Remove tabs or spaces from the start of
+             * the line, and the continuation character from its end */
+            const char *line_start = start;
+            while (line_start[0] == '\t' || line_start[0] == ' ') {
+                line_start++;
+            }
+
+            ret_code = _splice_piece(this, used, line_start,
+                                     line_end - 2 - line_start);
+            if (ret_code != 0) { return ret_code; }
+
+            used += line_end - 2 - line_start;
+            had_multi = TRUE;
+            start = line_end;
+            continue;
+        }
+
+        if (!had_multi) {
+            /* The usual case, the line is returned as it is */
+            *line = start;
+            *len = line_end - start;
+            this->_pos = line_end - this->_data;
+            return 1;
+        }
+
+        /* The line is ended */
+        while (start < line_end && (start[0] == '\t' || start[0] == ' ')) {
+            start++;
+        }
+
+        ret_code = _splice_piece(this, used, start, line_end - start);
+        if (ret_code != 0) { return ret_code; }
+
+        used += line_end - start;
+        start = line_end;
+        break;
+    }
+
+    this->_pos = start - this->_data;
+
+    /* The input ended with a continued, empty, line */
+    if (used == 0) { return 0; }
+
+    *line = this->_splice;
+    *len = used;
+    return 1;
+}
+
+int reader_next_line(InputReader *const this, const char **line, size_t *len) {
+    int ret_code;
+
+    STATS_BEGIN(STATS_READ);
+    ret_code = _next_line(this, line, len);
+    STATS_END(STATS_READ, ret_code == 1 ? *len : 0);
+
+    return ret_code;
+}
+
+int reader_skip_to_directive(InputReader *const this) {
+    const char *start = this->_data + this->_pos;
+    const char *end = this->_data + this->_size;
+    const char *curr = start;
+    const char *line;
+
+    STATS_BEGIN(STATS_SKIP);
+    while (curr < end && (curr = memchr(curr, '#', end - curr)) != NULL) {
+        /* Only blanks can be before the '#', on its line */
+        line = curr;
+        while (line > start && (line[-1] == ' ' || line[-1] == '\t')) {
+            line--;
+        }
+
+        /* The line must not be the continuation of another one */
+        if (line == start ||
+            (line[-1] == '\n' &&
+             !(line - this->_data > 1 && line[-2] == '\\'))) {
+            this->_pos = line - this->_data;
+            STATS_END(STATS_SKIP, line - start);
+            return 1;
+        }
+
+        curr++;
+    }
+
+    this->_pos = this->_size;
+    STATS_END(STATS_SKIP, end - start);
+    return 0;
+}
+
+int reader_contents(InputReader *const this, const char **data,
+                    size_t *size) {
+    *data = this->_data;
+    *size = this->_size;
+    return 0;
+}
+
+int reader_close(InputReader *const this) {
+    if (this->_is_owner) {
+#ifdef READER_USE_MMAP
+        if (this->_is_mapped) {
+            munmap(this->_data, this->_size);
+        } else {
+            free(this->_data);
+        }
+#else
+        free(this->_data);
+#endif
+    }
+    free(this->_splice);
+
+    this->_data = NULL;
+    this->_splice = NULL;
+    this->_size = 0;
+    this->_pos = 0;
+    this->_splice_cap = 0;
+    this->_is_mapped = FALSE;
+    this->_is_owner = FALSE;
+    return 0;
+}
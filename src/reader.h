@@ -0,0 +1,119 @@
+/**
+ * @file reader.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the input reader
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef READER_H
+#define READER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error_handling.h"
+
+#define READER_CHUNK_SIZE 65536 /* Read size, for inputs that can't be mapped */
+
+/* A "constructor" for the reader */
+#define INIT_READER                                                      \
+    {                                                                    \
+        0, 0, 0, 0, 0, 0, 0, reader_open, reader_open_copy, reader_view, \
+            reader_next_line, reader_skip_to_directive, reader_contents, \
+            reader_close                                                 \
+    }
+
+/**
+ * @brief An input reader. Regular files are memory-mapped, other inputs
+ * (stdin, pipes) are read in large chunks into a single buffer. The lines are
+ * returned as spans (pointer + length) into that memory, so they are not
+ * copied, except for the lines that use the line continuation character.
+ */
+typedef struct InputReader {
+    string _data;
+    size_t _size;
+    size_t _pos;
+    int _is_mapped;
+    int _is_owner;      /* The data is released by this reader */
+    string _splice;     /* Buffer for the continued lines */
+    size_t _splice_cap; /* The capacity of the splice buffer */
+
+    int (*open)(struct InputReader *const this, FILE *input);
+    int (*open_copy)(struct InputReader *const this, FILE *input);
+    int (*view)(struct InputReader *const this, struct InputReader *view);
+    int (*next_line)(struct InputReader *const this, const char **line,
+                     size_t *len);
+    int (*skip_to_directive)(struct InputReader *const this);
+    int (*contents)(struct InputReader *const this, const char **data,
+                    size_t *size);
+    int (*close)(struct InputReader *const this);
+} InputReader;
+
+/**
+ * @brief Prepare the data of an input file for reading
+ * @param this The reader this function is attached to
+ * @param input The input FILE
+ * @return int The return code (0 for no errors)
+ */
+int reader_open(InputReader *const this, FILE *input);
+
+/**
+ * @brief Read the data of an input file into memory, even if the file could be
+ * mapped. It is used for the inputs that are kept while the file can change
+ * (a mapped file that is truncated can't be read anymore).
+ * @param this The reader this function is attached to
+ * @param input The input FILE
+ * @return int The return code (0 for no errors)
+ */
+int reader_open_copy(InputReader *const this, FILE *input);
+
+/**
+ * @brief Create a new reader over the same data, starting from the first line.
+ * The view doesn't own the data, so it must be closed before this reader.
+ * @param this The reader this function is attached to
+ * @param view The new reader
+ * @return int The return code (0 for no errors)
+ */
+int reader_view(InputReader *const this, InputReader *view);
+
+/**
+ * @brief Get the next line of the input (it takes into account the line
+ * continuation character). The line is not null-terminated, and it is valid
+ * only until the next call.
+ * @param this The reader this function is attached to
+ * @param line The start of the line (including the newline, if it exists)
+ * @param len The length of the line
+ * @return int The return code (0 for EOF, 1 for Success, others for errors)
+ */
+int reader_next_line(InputReader *const this, const char **line, size_t *len);
+
+/**
+ * @brief Skip the lines until the next one that starts with '#' (after spaces
+ * or tabs), without returning them. It is used for the inactive regions, where
+ * only the directives matter. The raw data is searched for '#', so the skipped
+ * lines are never split or copied.
+ * @param this The reader this function is attached to
+ * @return int 1 if such a line was found (it is the next one returned by
+ * next_line), 0 if the input ended
+ */
+int reader_skip_to_directive(InputReader *const this);
+
+/**
+ * @brief Get all the data of the input (used for binary inputs). The data is
+ * valid until the reader is closed.
+ * @param this The reader this function is attached to
+ * @param data The start of the data
+ * @param size The size of the data
+ * @return int The return code (0 for no errors)
+ */
+int reader_contents(InputReader *const this, const char **data, size_t *size);
+
+/**
+ * @brief Release the input data (unmap or free it, if this reader owns it)
+ * @param this The reader this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int reader_close(InputReader *const this);
+
+#endif
@@ -0,0 +1,443 @@
+/**
+ * @file resolver.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the include path resolver
+ * @copyright Copyright (c) 2021
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define RESOLVER_USE_OPENAT
+#endif
+
+#include "resolver.h"
+
+#ifdef RESOLVER_USE_OPENAT
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Make sure the paths buffer can hold a string of the specified length
+ * @param this The resolver
+ * @param len The length of the string
+ * @return int The return code
+ */
+int _reserve_buffer(IncludeResolver *const this, size_t len) {
+    size_t new_capacity =
+        this->_buffer_cap == 0 ? RESOLVER_BUFFER_SIZE : this->_buffer_cap;
+    string aux_buff;
+
+    if (len < this->_buffer_cap) { return 0; }
+
+    while (new_capacity <= len) { new_capacity *= 2; }
+
+    aux_buff = realloc(this->_buffer, new_capacity);
+    if (aux_buff == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the path");
+        return MALLOC_ERR;
+    }
+    this->_buffer = aux_buff;
+    this->_buffer_cap = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Build the "dir/name" path in the paths buffer
+ * @param this The resolver
+ * @param dir The directory
+ * @param dir_len The length of the directory
+ * @param name The name of the file
+ * @return int The return code
+ */
+int _build_path(IncludeResolver *const this, const char *dir, size_t dir_len,
+                string name) {
+    size_t name_len = strlen(name);
+    int ret_code = _reserve_buffer(this, dir_len + name_len + 1);
+
+    if (ret_code != 0) { return ret_code; }
+
+    memcpy(this->_buffer, dir, dir_len);
+    this->_buffer[dir_len] = '/';
+    memcpy(this->_buffer + dir_len + 1, name, name_len + 1);
+    return 0;
+}
+
+/**
+ * @brief Record the directory of a path that is searched (only when watching),
+ * with its current version
+ * @param this The resolver
+ * @param path The searched path
+ * @return int The return code
+ */
+int _watch_dir(IncludeResolver *const this, const char *path) {
+    const char *slash = strrchr(path, '/');
+    size_t len = slash == NULL ? 1 : (slash == path ? 1 : slash - path);
+    unsigned long h;
+    DirStamp *stamp;
+    int i;
+
+    if (!this->_watch) { return 0; }
+    if (slash == NULL) { path = "."; }
+
+    h = hash_span(path, len);
+    for (i = 0; i < this->_c_stamps; ++i) {
+        if (this->_stamps[i].hash == h &&
+            strncmp(this->_stamps[i].path, path, len) == 0 &&
+            this->_stamps[i].path[len] == '\0') {
+            return 0;
+        }
+    }
+
+    /* A new directory */
+    if (this->_c_stamps == this->_stamps_cap) {
+        int new_capacity = this->_stamps_cap == 0 ? 8 : this->_stamps_cap * 2;
+        DirStamp *aux_buff =
+            realloc(this->_stamps, new_capacity * sizeof(DirStamp));
+
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the directories");
+            return MALLOC_ERR;
+        }
+        this->_stamps = aux_buff;
+        this->_stamps_cap = new_capacity;
+    }
+
+    stamp = &this->_stamps[this->_c_stamps];
+    stamp->path = calloc(len + 1, 1);
+    if (stamp->path == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the directory");
+        return MALLOC_ERR;
+    }
+    memcpy(stamp->path, path, len);
+    stamp->hash = h;
+    stamp_path(stamp->path, &stamp->stamp);
+
+    this->_c_stamps++;
+    return 0;
+}
+
+/**
+ * @brief Check if a path is a regular file that can be read
+ * @param path The path
+ * @return int TRUE if the file exists, FALSE otherwise
+ */
+int _probe_path(const char *path) {
+#ifdef RESOLVER_USE_OPENAT
+    struct stat st;
+
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+#else
+    FILE *check = fopen(path, "r");
+
+    if (check == NULL) { return FALSE; }
+    fclose(check);
+    return TRUE;
+#endif
+}
+
+/**
+ * @brief Search a file in one of the include directories. If the directory is
+ * opened, the file is checked relative to it, so its full path is built only
+ * when it exists.
+ * @param this The resolver
+ * @param i The index of the directory
+ * @param name The name of the file
+ * @return int The return code (0 if found and the path is in the buffer, 1 if
+ * not found, other - error)
+ */
+int _probe_dir(IncludeResolver *const this, int i, string name) {
+    size_t dir_len = strlen(this->_dirs[i]);
+    int ret_code;
+
+#ifdef RESOLVER_USE_OPENAT
+    if (this->_dir_fds[i] >= 0) {
+        struct stat st;
+
+        if (this->_watch) {
+            ret_code = _build_path(this, this->_dirs[i], dir_len, name);
+            if (ret_code == 0) { ret_code = _watch_dir(this, this->_buffer); }
+            if (ret_code != 0) { return ret_code; }
+        }
+
+        if (fstatat(this->_dir_fds[i], name, &st, 0) != 0 ||
+            !S_ISREG(st.st_mode)) {
+            return 1;
+        }
+        return _build_path(this, this->_dirs[i], dir_len, name);
+    }
+#endif
+
+    ret_code = _build_path(this, this->_dirs[i], dir_len, name);
+    if (ret_code == 0) { ret_code = _watch_dir(this, this->_buffer); }
+    if (ret_code != 0) { return ret_code; }
+
+    return _probe_path(this->_buffer) ? 0 : 1;
+}
+
+/**
+ * @brief Search a file in all the places it can be. The path of the file is
+ * left in the paths buffer.
+ * @param this The resolver
+ * @param cur_dir The directory of the current file
+ * @param cur_dir_len The length of the directory
+ * @param name The name of the file
+ * @param quoted If the "file" form was used
+ * @return int The return code (0 if found, 1 if not found, other - error)
+ */
+int _search(IncludeResolver *const this, const char *cur_dir,
+            size_t cur_dir_len, string name, int quoted) {
+    int ret_code;
+    int i;
+
+    if (name[0] == '/') {
+        /* Absolute paths are not searched */
+        ret_code = _reserve_buffer(this, strlen(name));
+        if (ret_code != 0) { return ret_code; }
+
+        strcpy(this->_buffer, name);
+        ret_code = _watch_dir(this, this->_buffer);
+        if (ret_code != 0) { return ret_code; }
+
+        return _probe_path(this->_buffer) ? 0 : 1;
+    }
+
+    if (quoted) {
+        if (cur_dir != NULL) {
+            ret_code = _build_path(this, cur_dir, cur_dir_len, name);
+        } else {
+            ret_code = _reserve_buffer(this, strlen(name));
+            if (ret_code == 0) { strcpy(this->_buffer, name); }
+        }
+        if (ret_code == 0) { ret_code = _watch_dir(this, this->_buffer); }
+        if (ret_code != 0) { return ret_code; }
+
+        if (_probe_path(this->_buffer)) { return 0; }
+    }
+
+    for (i = 0; i < this->_c_dirs; ++i) {
+        ret_code = _probe_dir(this, i, name);
+        if (ret_code != 1) { return ret_code; }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Open the include directories (the directories that can't be opened
+ * are searched by their paths)
+ * @param this The resolver
+ */
+void _open_dirs(IncludeResolver *const this) {
+    int i;
+
+    for (i = 0; i < this->_c_dirs; ++i) {
+#ifdef RESOLVER_USE_OPENAT
+        this->_dir_fds[i] = open(this->_dirs[i], O_RDONLY | O_DIRECTORY);
+#else
+        this->_dir_fds[i] = -1;
+#endif
+    }
+}
+
+/**
+ * @brief Close the include directories
+ * @param this The resolver
+ */
+void _close_dirs(IncludeResolver *const this) {
+    int i;
+
+    for (i = 0; this->_dir_fds != NULL && i < this->_c_dirs; ++i) {
+#ifdef RESOLVER_USE_OPENAT
+        if (this->_dir_fds[i] >= 0) { close(this->_dir_fds[i]); }
+#endif
+        this->_dir_fds[i] = -1;
+    }
+}
+
+/**
+ * @brief Forget the searched directories
+ * @param this The resolver
+ */
+void _clear_stamps(IncludeResolver *const this) {
+    int i;
+
+    for (i = 0; i < this->_c_stamps; ++i) { free(this->_stamps[i].path); }
+    this->_c_stamps = 0;
+}
+
+/**
+ * @brief Record a found file (only when recording)
+ * @param this The resolver
+ * @param path The path of the file
+ * @return int The return code
+ */
+int _record_path(IncludeResolver *const this, const char *path) {
+    const StringsPair *recorded;
+    StringsPair new_pair;
+
+    if (!this->_record ||
+        this->_recorded.find(&this->_recorded, (string)path, &recorded) == 0) {
+        return 0;
+    }
+
+    if (this->_c_found == this->_found_cap) {
+        int new_cap = this->_found_cap == 0 ? 16 : this->_found_cap * 2;
+        const char **aux_buff =
+            realloc((void *)this->_found, new_cap * sizeof(const char *));
+
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the found files");
+            return MALLOC_ERR;
+        }
+        this->_found = aux_buff;
+        this->_found_cap = new_cap;
+    }
+
+    new_pair.first = (string)path;
+    new_pair.second = "";
+    if (this->_recorded.put(&this->_recorded, new_pair) < 0) {
+        return MALLOC_ERR;
+    }
+
+    /* The copy of the path that is kept by the map */
+    this->_recorded.find(&this->_recorded, (string)path, &recorded);
+    this->_found[this->_c_found++] = recorded->first;
+    return 0;
+}
+
+int resolver_init(IncludeResolver *const this, string *dirs, int c_dirs) {
+
+    this->_dirs = dirs;
+    this->_c_dirs = c_dirs;
+    this->_dir_fds = calloc(c_dirs + 1, sizeof(int));
+    if (this->_dir_fds == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the include directories");
+        return MALLOC_ERR;
+    }
+
+    _open_dirs(this);
+    return this->_cache.init(&this->_cache);
+}
+
+int resolver_resolve(IncludeResolver *const this, const char *cur_dir,
+                     size_t cur_dir_len, string name, int quoted,
+                     const char **path) {
+    const StringsPair *cached;
+    StringsPair result;
+    size_t name_len = strlen(name);
+    size_t key_len;
+    int ret_code;
+
+    /* The key of the search: the form, the name, and the directory of the
+     * current file (only if it is used by the search) */
+    key_len = name_len + 2 + (quoted && cur_dir != NULL ? cur_dir_len : 0);
+    ret_code = _reserve_buffer(this, key_len);
+    if (ret_code != 0) { return ret_code; }
+
+    this->_buffer[0] = quoted ? '"' : '<';
+    memcpy(this->_buffer + 1, name, name_len);
+    this->_buffer[name_len + 1] = '\n';
+    if (key_len != name_len + 2) {
+        memcpy(this->_buffer + name_len + 2, cur_dir, cur_dir_len);
+    }
+    this->_buffer[key_len] = '\0';
+
+    if (this->_cache.find(&this->_cache, this->_buffer, &cached) == 0) {
+        *path = cached->second;
+        if (cached->second[0] == '\0') { return 1; }
+        return _record_path(this, *path);
+    }
+
+    result.first = calloc(key_len + 1, 1);
+    if (result.first == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the search");
+        return MALLOC_ERR;
+    }
+    memcpy(result.first, this->_buffer, key_len + 1);
+
+    ret_code = _search(this, cur_dir, cur_dir_len, name, quoted);
+    if (ret_code < 0) {
+        free(result.first);
+        return ret_code;
+    }
+
+    /* Cache the result, found or not */
+    result.second = ret_code == 0 ? this->_buffer : "";
+    if (this->_cache.put(&this->_cache, result) < 0) {
+        free(result.first);
+        return MALLOC_ERR;
+    }
+
+    this->_cache.find(&this->_cache, result.first, &cached);
+    free(result.first);
+
+    *path = cached->second;
+    if (ret_code == 0) { ret_code = _record_path(this, *path); }
+    return ret_code;
+}
+
+int resolver_watch(IncludeResolver *const this) {
+    this->_watch = TRUE;
+    return 0;
+}
+
+int resolver_revalidate(IncludeResolver *const this) {
+    FileStamp stamp;
+    int i;
+
+    for (i = 0; i < this->_c_stamps; ++i) {
+        stamp_path(this->_stamps[i].path, &stamp);
+        if (!stamp_equal(&stamp, &this->_stamps[i].stamp)) { break; }
+    }
+    if (i == this->_c_stamps) { return 0; }
+
+    /* The directories could have been replaced too */
+    _close_dirs(this);
+    _open_dirs(this);
+    _clear_stamps(this);
+
+    this->_cache.clear(&this->_cache);
+    if (this->_cache.init(&this->_cache) != 0) { return MALLOC_ERR; }
+    return 1;
+}
+
+int resolver_record(IncludeResolver *const this) {
+    this->_recorded.clear(&this->_recorded);
+    this->_c_found = 0;
+    this->_record = TRUE;
+    return this->_recorded.init(&this->_recorded);
+}
+
+int resolver_recorded(IncludeResolver *const this, const char *const **paths,
+                      int *count) {
+    *paths = this->_found;
+    *count = this->_c_found;
+    return 0;
+}
+
+int resolver_clear(IncludeResolver *const this) {
+    _close_dirs(this);
+    _clear_stamps(this);
+    free(this->_stamps);
+    free(this->_dir_fds);
+    free(this->_buffer);
+    free((void *)this->_found);
+    this->_cache.clear(&this->_cache);
+    this->_recorded.clear(&this->_recorded);
+
+    this->_dirs = NULL;
+    this->_dir_fds = NULL;
+    this->_c_dirs = 0;
+    this->_buffer = NULL;
+    this->_buffer_cap = 0;
+    this->_stamps = NULL;
+    this->_stamps_cap = 0;
+    this->_watch = FALSE;
+    this->_found = NULL;
+    this->_c_found = 0;
+    this->_found_cap = 0;
+    this->_record = FALSE;
+    return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file resolver.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the include path resolver
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "hashmap.h"
+#include "stamp.h"
+
+#define RESOLVER_BUFFER_SIZE 256 /* Initial size of the paths buffer */
+
+/* A "constructor" for the resolver */
+#define INIT_RESOLVER                                                    \
+    {                                                                    \
+        0, 0, 0, INIT_HASHMAP, 0, 0, 0, 0, 0, 0, INIT_HASHMAP, 0, 0, 0,  \
+            0, resolver_init, resolver_resolve, resolver_watch,          \
+            resolver_revalidate, resolver_record, resolver_recorded,     \
+            resolver_clear                                               \
+    }
+
+/**
+ * @brief A directory that was searched, and its version at that time
+ */
+typedef struct DirStamp {
+    unsigned long hash; /* The hash of the path */
+    string path;
+    FileStamp stamp;
+} DirStamp;
+
+/**
+ * @brief Finds the files named by the #include directives. The result of
+ * every search (found or not) is cached for the whole run, and the include
+ * directories are opened once, so the files are probed relative to them
+ * without building their full paths.
+ */
+typedef struct IncludeResolver {
+    string *_dirs; /* The include directories (owned by the preprocessor) */
+    int *_dir_fds; /* The opened include directories (-1 if not opened) */
+    int _c_dirs;
+    Hashmap _cache; /* Search -> the resolved path ("" if not found) */
+    string _buffer; /* Used to build the paths and the cache keys */
+    size_t _buffer_cap;
+    DirStamp *_stamps; /* The searched directories (only when watching) */
+    int _c_stamps;
+    int _stamps_cap;
+    int _watch;
+    Hashmap _recorded;     /* The found files, since recording started */
+    const char **_found;   /* The same files, in the order they were found */
+    int _c_found;
+    int _found_cap;
+    int _record;
+
+    int (*init)(struct IncludeResolver *const this, string *dirs, int c_dirs);
+    int (*resolve)(struct IncludeResolver *const this, const char *cur_dir,
+                   size_t cur_dir_len, string name, int quoted,
+                   const char **path);
+    int (*watch)(struct IncludeResolver *const this);
+    int (*revalidate)(struct IncludeResolver *const this);
+    int (*record)(struct IncludeResolver *const this);
+    int (*recorded)(struct IncludeResolver *const this,
+                    const char *const **paths, int *count);
+    int (*clear)(struct IncludeResolver *const this);
+} IncludeResolver;
+
+/**
+ * @brief Initialise the resolver, and open the include directories
+ * @param this The resolver this function is attached to
+ * @param dirs The include directories, in the search order
+ * @param c_dirs The number of include directories
+ * @return int The return code
+ */
+int resolver_init(IncludeResolver *const this, string *dirs, int c_dirs);
+
+/**
+ * @brief Find an included file. The "file" form is searched in the directory
+ * of the current file, then in the include directories; the <file> form only
+ * in the include directories.
+ * @param this The resolver this function is attached to
+ * @param cur_dir The directory of the current file (NULL for the current
+ * directory)
+ * @param cur_dir_len The length of the directory
+ * @param name The name of the file, as it was written in the directive
+ * @param quoted If the "file" form was used
+ * @param path The path of the file (owned by the resolver)
+ * @return int The return code (0 if found, 1 if not found, other - error)
+ */
+int resolver_resolve(IncludeResolver *const this, const char *cur_dir,
+                     size_t cur_dir_len, string name, int quoted,
+                     const char **path);
+
+/**
+ * @brief Record the directories the searches depend on, so the cached results
+ * can be checked later (used by long running processes)
+ * @param this The resolver this function is attached to
+ * @return int The return code
+ */
+int resolver_watch(IncludeResolver *const this);
+
+/**
+ * @brief Check the searched directories. If any of them changed (files were
+ * added, removed or renamed), the cached results are dropped, and the include
+ * directories are opened again
+ * @param this The resolver this function is attached to
+ * @return int The return code (0 if the cache is still valid, 1 if it was
+ * dropped, other - error)
+ */
+int resolver_revalidate(IncludeResolver *const this);
+
+/**
+ * @brief Start recording the files that are found (the files recorded before
+ * are forgotten). Every file is recorded once, even if it is found by
+ * different searches.
+ * @param this The resolver this function is attached to
+ * @return int The return code
+ */
+int resolver_record(IncludeResolver *const this);
+
+/**
+ * @brief Get the files found since the recording started
+ * @param this The resolver this function is attached to
+ * @param paths The paths of the files, in the order they were first found
+ * (owned by the resolver)
+ * @param count The number of files
+ * @return int The return code
+ */
+int resolver_recorded(IncludeResolver *const this, const char *const **paths,
+                      int *count);
+
+/**
+ * @brief Close the include directories and free the cache
+ * @param this The resolver this function is attached to
+ * @return int The return code
+ */
+int resolver_clear(IncludeResolver *const this);
+
+#endif
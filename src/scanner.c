@@ -0,0 +1,187 @@
+/**
+ * @file scanner.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the characters scanner. The portable version
+ * uses a table with the classes of every character. On x86-64 (with
+ * gcc/clang), vectorised versions that check 16 (SSE2) or 32 (AVX2)
+ * characters at once are also available.
+ * @copyright Copyright (c) 2021
+ */
+
+#include "scanner.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SCANNER_USE_SIMD
+#include <immintrin.h>
+#endif
+
+uchar _char_class[256];
+
+/* The scanning functions that are used for every class (selected at
+ * initialisation) */
+size_t (*_scan_span[SCAN_CLASSES])(const char *data, size_t len, int kind);
+
+/**
+ * @brief Find the first character that is not of the specified class, using
+ * the table
+ * @param data The start of the span
+ * @param len The length of the span
+ * @param kind The class (SCAN_...)
+ * @return size_t The offset of the character (len if there is none)
+ */
+size_t _scan_table(const char *data, size_t len, int kind) {
+    size_t i = 0;
+
+    while (i < len && (_char_class[(uchar)data[i]] & (1 << kind))) { i++; }
+    return i;
+}
+
+#ifdef SCANNER_USE_SIMD
+
+#define SCANNER_RANGES_MAX 64 /* Enough for any set of ASCII characters */
+
+/* The characters of every class, as ranges, used by the SSE2 version */
+char _range_lo[SCAN_CLASSES][SCANNER_RANGES_MAX];
+char _range_hi[SCAN_CLASSES][SCANNER_RANGES_MAX];
+int _ranges_count[SCAN_CLASSES];
+
+/* Low/high nibble tables, used by the AVX2 version. A character is of a class
+ * if the bit of its high nibble is set in the entry of its low nibble. */
+uchar _lo_nibbles[SCAN_CLASSES][16];
+uchar _hi_nibbles[16];
+
+/**
+ * @brief Find the first character that is not of the specified class,
+ * checking 16 characters at once (two comparisons for every range)
+ * @param data The start of the span
+ * @param len The length of the span
+ * @param kind The class (SCAN_...)
+ * @return size_t The offset of the character (len if there is none)
+ */
+size_t _scan_sse2(const char *data, size_t len, int kind) {
+    size_t i = 0;
+    int j;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i found = _mm_setzero_si128();
+        unsigned int mask;
+
+        /* The non-ASCII characters are negative, so they are in no range */
+        for (j = 0; j < _ranges_count[kind]; ++j) {
+            __m128i above = _mm_cmpgt_epi8(
+                chunk, _mm_set1_epi8((char)(_range_lo[kind][j] - 1)));
+            __m128i past = _mm_cmpgt_epi8(chunk,
+                                          _mm_set1_epi8(_range_hi[kind][j]));
+            found = _mm_or_si128(found, _mm_andnot_si128(past, above));
+        }
+
+        mask = ~(unsigned int)_mm_movemask_epi8(found) & 0xFFFFu;
+        if (mask != 0) { return i + __builtin_ctz(mask); }
+    }
+
+    return i + _scan_table(data + i, len - i, kind);
+}
+
+/**
+ * @brief Find the first character that is not of the specified class,
+ * checking 32 characters at once (with the nibble tables)
+ * @param data The start of the span
+ * @param len The length of the span
+ * @param kind The class (SCAN_...)
+ * @return size_t The offset of the character (len if there is none)
+ */
+__attribute__((target("avx2"))) size_t _scan_avx2(const char *data,
+                                                  size_t len, int kind) {
+    size_t i = 0;
+    __m256i lo_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)_lo_nibbles[kind]));
+    __m256i hi_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)_hi_nibbles));
+    __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i lo = _mm256_and_si256(chunk, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble);
+        __m256i bits = _mm256_and_si256(_mm256_shuffle_epi8(lo_table, lo),
+                                        _mm256_shuffle_epi8(hi_table, hi));
+
+        /* The mask has the bits of the characters of other classes set */
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(bits, _mm256_setzero_si256()));
+        if (mask != 0) { return i + __builtin_ctz(mask); }
+    }
+
+    return i + _scan_table(data + i, len - i, kind);
+}
+
+/**
+ * @brief Build the SIMD tables of a class, and select its scanning function
+ * @param kind The class (SCAN_...)
+ */
+void _scanner_init_simd(int kind) {
+    int c;
+
+    _ranges_count[kind] = 0;
+    memset(_lo_nibbles[kind], 0, sizeof(_lo_nibbles[kind]));
+
+    /* The tables can't describe the non-ASCII characters */
+    for (c = 128; c < 256; ++c) {
+        if (_char_class[c] & (1 << kind)) { return; }
+    }
+
+    for (c = 0; c < 128; ++c) {
+        if (!(_char_class[c] & (1 << kind))) { continue; }
+
+        _lo_nibbles[kind][c & 0x0F] |= (uchar)(1 << (c >> 4));
+        if (c > 0 && (_char_class[c - 1] & (1 << kind))) {
+            _range_hi[kind][_ranges_count[kind] - 1] = (char)c;
+        } else {
+            _range_lo[kind][_ranges_count[kind]] = (char)c;
+            _range_hi[kind][_ranges_count[kind]++] = (char)c;
+        }
+    }
+
+    if (__builtin_cpu_supports("avx2")) {
+        _scan_span[kind] = _scan_avx2;
+    } else {
+        _scan_span[kind] = _scan_sse2;
+    }
+}
+
+#endif
+
+int scanner_init(const char *delims) {
+    int c;
+
+    memset(_char_class, 0, sizeof(_char_class));
+    for (; *delims != '\0'; ++delims) {
+        _char_class[(uchar)*delims] |= 1 << SCAN_DELIM;
+    }
+    for (c = 0; c < 256; ++c) {
+        if (c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9')) {
+            _char_class[c] |= 1 << SCAN_IDENT;
+        }
+    }
+
+    _scan_span[SCAN_DELIM] = _scan_table;
+    _scan_span[SCAN_IDENT] = _scan_table;
+
+#ifdef SCANNER_USE_SIMD
+    for (c = 0; c < 16; ++c) { _hi_nibbles[c] = c < 8 ? (uchar)(1 << c) : 0; }
+    _scanner_init_simd(SCAN_DELIM);
+    _scanner_init_simd(SCAN_IDENT);
+#endif
+
+    return 0;
+}
+
+size_t scan_word(const char *data, size_t len) {
+    return _scan_span[SCAN_DELIM](data, len, SCAN_DELIM);
+}
+
+size_t scan_ident(const char *data, size_t len) {
+    return _scan_span[SCAN_IDENT](data, len, SCAN_IDENT);
+}
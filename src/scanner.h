@@ -0,0 +1,56 @@
+/**
+ * @file scanner.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the characters scanner
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include "error_handling.h"
+
+/* The classes of characters the scanner knows */
+#define SCAN_DELIM 0   /* The delimiters */
+#define SCAN_IDENT 1   /* The characters of the identifiers and numbers */
+#define SCAN_CLASSES 2
+
+/* Check the class of a character (the scanner must be initialised) */
+#define IS_DELIM(c) (_char_class[(uchar)(c)] & (1 << SCAN_DELIM))
+#define IS_IDENT(c) (_char_class[(uchar)(c)] & (1 << SCAN_IDENT))
+
+/* The character class table, one entry (a bit for every class) for each
+ * character */
+extern uchar _char_class[256];
+
+/**
+ * @brief Initialise the scanner for a set of delimiters. It builds the
+ * character class table and selects the fastest scanning function the CPU
+ * supports for every class (AVX2 or SSE2 on x86-64, the table otherwise). It
+ * must be called before any scan.
+ * @param delims The delimiters
+ * @return int The return code (0 for no errors)
+ */
+int scanner_init(const char *delims);
+
+/**
+ * @brief Find the first character of a span that is not a delimiter
+ * @param data The start of the span
+ * @param len The length of the span
+ * @return size_t The offset of the character (len if there is none)
+ */
+size_t scan_word(const char *data, size_t len);
+
+/**
+ * @brief Find the first character of a span that can't be part of an
+ * identifier (or of a number)
+ * @param data The start of the span
+ * @param len The length of the span
+ * @return size_t The offset of the character (len if there is none)
+ */
+size_t scan_ident(const char *data, size_t len);
+
+#endif
@@ -0,0 +1,633 @@
+/**
+ * @file server.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the server (daemon) mode
+ * @copyright Copyright (c) 2021
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _XOPEN_SOURCE 700
+#define SERVER_USE_SOCKETS
+#endif
+
+#include "server.h"
+
+#ifdef SERVER_USE_SOCKETS
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* The ancillary data used to send the standard input/output */
+typedef union ServerControl {
+    struct cmsghdr align;
+    char data[CMSG_SPACE(2 * sizeof(int))];
+} ServerControl;
+
+/**
+ * @brief Read exactly the specified number of bytes
+ * @param fd The file descriptor
+ * @param buffer The buffer
+ * @param len The number of bytes
+ * @return int The return code
+ */
+int _read_full(int fd, char *buffer, size_t len) {
+    ssize_t ret;
+
+    while (len != 0) {
+        ret = read(fd, buffer, len);
+        if (ret <= 0) {
+            CERR(ret < 0, "Couldn't read from the socket");
+            return IO_ERR;
+        }
+        buffer += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write all the specified bytes
+ * @param fd The file descriptor
+ * @param buffer The buffer
+ * @param len The number of bytes
+ * @return int The return code
+ */
+int _write_full(int fd, const char *buffer, size_t len) {
+    ssize_t ret;
+
+    while (len != 0) {
+        ret = write(fd, buffer, len);
+        if (ret < 0) {
+            CERR(TRUE, "Couldn't write to the socket");
+            return IO_ERR;
+        }
+        buffer += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Create the address of the socket
+ * @param path The path of the socket
+ * @param addr The address
+ * @return int The return code
+ */
+int _socket_address(string path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        DEBUG_MSG("The socket path is too long");
+        return IO_ERR;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ * @brief Receive a request: the header (with the standard input/output of the
+ * client), then the payload (the working directory and the arguments, all
+ * null-terminated)
+ * @param conn The connection
+ * @param payload The payload (must be freed)
+ * @param len The length of the payload
+ * @param fds The standard input/output of the client (-1 if not received)
+ * @return int The return code
+ */
+int _receive_request(int conn, string *payload, size_t *len, int fds[2]) {
+    char header[SERVER_HEADER_SIZE + 1];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    ServerControl control;
+    ssize_t received;
+    size_t used = 0;
+    string end;
+    long size;
+
+    fds[0] = -1;
+    fds[1] = -1;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = header;
+    iov.iov_len = SERVER_HEADER_SIZE;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data;
+    msg.msg_controllen = sizeof(control.data);
+
+    received = recvmsg(conn, &msg, 0);
+    if (received <= 0) { return IO_ERR; }
+    used = received;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))) {
+            memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+        }
+    }
+
+    /* The header is the length of the payload, on its own line */
+    header[used] = '\0';
+    while ((end = strchr(header, '\n')) == NULL && used < SERVER_HEADER_SIZE) {
+        received = read(conn, header + used, SERVER_HEADER_SIZE - used);
+        if (received <= 0) { return IO_ERR; }
+        used += received;
+        header[used] = '\0';
+    }
+
+    size = end != NULL ? strtol(header, NULL, 10) : -1;
+    if (size <= 0 || size > SERVER_REQUEST_MAX) {
+        DEBUG_MSG("Invalid request");
+        return IO_ERR;
+    }
+
+    *payload = calloc(size + 1, 1);
+    if (*payload == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the request");
+        return MALLOC_ERR;
+    }
+
+    /* Some of the payload could have been read with the header */
+    used -= end + 1 - header;
+    if ((long)used > size) { used = size; }
+    memcpy(*payload, end + 1, used);
+
+    *len = size;
+    return _read_full(conn, *payload + used, size - used);
+}
+
+/**
+ * @brief Split the arguments of a request into the state arguments (-D, -I,
+ * -P), and the input/output files. The options are read like on the command
+ * line; the ones the server can't run (the batch mode, the dependency output,
+ * the snapshot saves) are rejected, as their clients run them locally. -j is
+ * ignored, like it is without -B.
+ * @param argc The arguments count
+ * @param argv The arguments vector
+ * @param state The state arguments, each of them with its value (after the
+ * program name, so they can be parsed as a command line)
+ * @param c_state The number of state arguments (with the program name)
+ * @param input The input file (NULL for the standard input)
+ * @param output The output file (NULL for the standard output)
+ * @return int The return code (FILE_ERR for the rejected arguments)
+ */
+int _split_arguments(int argc, string argv[], string *state, int *c_state,
+                     string *input, string *output) {
+    string option;
+    string value;
+    int ret_code;
+    int i;
+
+    state[0] = "";
+    *c_state = 1;
+    *input = NULL;
+    *output = NULL;
+
+    for (i = 0; i < argc; ++i) {
+        if (argv[i][0] == '@') {
+            CERR(TRUE, "The batch inputs can't be sent to the server");
+            return FILE_ERR;
+        } else if (argv[i][0] != '-') {
+            if (*input == NULL) {
+                *input = argv[i];
+            } else {
+                *output = argv[i];
+            }
+            continue;
+        }
+
+        option = argv[i];
+        ret_code = cpreprocessor_option(argc, argv, &i, &value);
+        if (ret_code < 0) { return ret_code; }
+
+        switch (option[1]) {
+            case 'o': {
+                *output = value;
+            } break;
+            case 'D':
+            case 'I':
+            case 'P': {
+                state[*c_state] = calloc(strlen(value) + 3, 1);
+                if (state[*c_state] == NULL) {
+                    CERR(TRUE, "Couldn't allocate memory");
+                    return MALLOC_ERR;
+                }
+
+                state[*c_state][0] = '-';
+                state[*c_state][1] = option[1];
+                strcpy(state[*c_state] + 2, value);
+                (*c_state)++;
+            } break;
+            case 'B':
+            case 'M':
+            case 'W':
+            case 'S':
+            case 'C': {
+                CERR(TRUE, "The option can't be sent to the server");
+                return FILE_ERR;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Check the files used by an entry, before it is reused: the cached
+ * headers and include paths, and the snapshot of the macros (-P), which is
+ * loaded again if it was saved since (the workers share it with the base)
+ * @param entry The entry
+ * @return int The return code (FILE_ERR if the snapshot can't be loaded)
+ */
+int _revalidate_entry(ServerEntry *entry) {
+    int ret_code;
+
+    entry->worker.headers.revalidate(&entry->worker.headers);
+    ret_code = entry->worker.resolver.revalidate(&entry->worker.resolver);
+    if (ret_code < 0) { return ret_code; }
+
+    if (entry->base.snapshot != NULL) {
+        ret_code = entry->base.snapshot->revalidate(entry->base.snapshot);
+        if (ret_code < 0) { return ret_code; }
+    }
+    return 0;
+}
+
+/**
+ * @brief Get the entry of a command line state, creating it if needed (the
+ * least recently used entry is replaced)
+ * @param entries The entries
+ * @param tick The current time (number of requests)
+ * @param cwd The working directory of the request
+ * @param state The state arguments (after the program name)
+ * @param c_state The number of state arguments (with the program name)
+ * @param entry The entry
+ * @return int The return code
+ */
+int _get_entry(ServerEntry *entries, unsigned long tick, string cwd,
+               string *state, int c_state, ServerEntry **entry) {
+    size_t key_len = strlen(cwd);
+    string key;
+    int i, ret_code;
+
+    for (i = 1; i < c_state; ++i) { key_len += strlen(state[i]) + 1; }
+
+    key = calloc(key_len + 1, 1);
+    if (key == NULL) {
+        CERR(TRUE, "Couldn't allocate memory");
+        return MALLOC_ERR;
+    }
+
+    strcpy(key, cwd);
+    for (i = 1; i < c_state; ++i) {
+        strcat(key, "\n");
+        strcat(key, state[i]);
+    }
+
+    /* Search the entry, and the least recently used one */
+    *entry = &entries[0];
+    for (i = 0; i < SERVER_ENTRIES_MAX; ++i) {
+        if (entries[i].key != NULL && strcmp(entries[i].key, key) == 0) {
+            *entry = &entries[i];
+
+            /* The files could have changed since the last request */
+            ret_code = _revalidate_entry(*entry);
+            if (ret_code == FILE_ERR) { break; }
+
+            free(key);
+            (*entry)->used = tick;
+            return ret_code < 0 ? ret_code : 0;
+        }
+
+        if (entries[i].key == NULL ||
+            ((*entry)->key != NULL && entries[i].used < (*entry)->used)) {
+            *entry = &entries[i];
+        }
+    }
+
+    /* The least recently used entry, or the one whose snapshot is gone (it is
+     * loaded again, so the request gets the error) */
+    if ((*entry)->key != NULL) {
+        (*entry)->worker.clear(&(*entry)->worker);
+        (*entry)->base.clear(&(*entry)->base);
+        free((*entry)->key);
+        (*entry)->key = NULL;
+    }
+
+    /* A new command line */
+    ret_code = cpreprocessor_init(&(*entry)->base, c_state, state);
+    if (ret_code != 0) {
+        free(key);
+        return ret_code;
+    }
+
+    ret_code = cpreprocessor_init_worker(&(*entry)->worker, &(*entry)->base);
+    if (ret_code != 0) {
+        (*entry)->base.clear(&(*entry)->base);
+        free(key);
+        return ret_code;
+    }
+    (*entry)->worker.resolver.watch(&(*entry)->worker.resolver);
+
+    (*entry)->key = key;
+    (*entry)->used = tick;
+    return 0;
+}
+
+/**
+ * @brief Preprocess a request
+ * @param entries The entries of the server
+ * @param tick The current time (number of requests)
+ * @param payload The payload of the request
+ * @param len The length of the payload
+ * @param fds The standard input/output of the client
+ * @return int The return code of the request
+ */
+int _handle_request(ServerEntry *entries, unsigned long tick, string payload,
+                    size_t len, int fds[2]) {
+    ServerEntry *entry;
+    string *argv;
+    string *state;
+    string input;
+    string output;
+    FILE *i_fd = NULL, *o_fd = NULL;
+    int argc = 0, c_state = 1;
+    int i, ret_code;
+    size_t pos;
+
+    /* The working directory, then the arguments */
+    for (pos = strlen(payload) + 1; pos < len; pos += strlen(payload + pos) + 1) {
+        argc++;
+    }
+
+    argv = calloc(argc + 1, sizeof(string));
+    state = calloc(argc + 1, sizeof(string));
+    if (argv == NULL || state == NULL) {
+        CERR(TRUE, "Couldn't allocate memory");
+        free(argv);
+        free(state);
+        return MALLOC_ERR;
+    }
+
+    argc = 0;
+    for (pos = strlen(payload) + 1; pos < len; pos += strlen(payload + pos) + 1) {
+        argv[argc++] = payload + pos;
+    }
+
+    ret_code = chdir(payload) == 0 ? 0 : FILE_ERR;
+    if (ret_code == 0) {
+        ret_code =
+            _split_arguments(argc, argv, state, &c_state, &input, &output);
+    }
+    if (ret_code == 0) {
+        ret_code =
+            _get_entry(entries, tick, payload, state, c_state, &entry);
+    }
+
+    /* Open the files (or use the ones of the client) */
+    if (ret_code == 0) {
+        i_fd = input != NULL ? fopen(input, "r") : fdopen(fds[0], "r");
+        if (i_fd == NULL) { ret_code = FILE_ERR; }
+        if (i_fd != NULL && input == NULL) { fds[0] = -1; }
+    }
+    if (ret_code == 0) {
+        o_fd = output != NULL ? fopen(output, "w") : fdopen(fds[1], "w");
+        if (o_fd == NULL) { ret_code = 1; }
+        if (o_fd != NULL && output == NULL) { fds[1] = -1; }
+    }
+
+    if (ret_code == 0) {
+        ret_code = cpreprocessor_process_files(&entry->worker, i_fd, input,
+                                               o_fd);
+    }
+
+    if (i_fd != NULL) { fclose(i_fd); }
+    if (o_fd != NULL) { fclose(o_fd); }
+
+    for (i = 1; i < c_state; ++i) { free(state[i]); }
+    free(state);
+    free(argv);
+    return ret_code;
+}
+
+int server_run(CPreprocessor *const this) {
+    struct sockaddr_un addr;
+    ServerEntry *entries;
+    unsigned long tick = 0;
+    char response[SERVER_HEADER_SIZE];
+    string payload;
+    size_t len;
+    int fds[2];
+    int server, conn, i;
+    int ret_code;
+
+    ret_code = _socket_address(this->socket, &addr);
+    if (ret_code != 0) { return ret_code; }
+
+    entries = calloc(SERVER_ENTRIES_MAX, sizeof(ServerEntry));
+    if (entries == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the server");
+        return MALLOC_ERR;
+    }
+
+    /* The clients can leave before the response is sent */
+    signal(SIGPIPE, SIG_IGN);
+
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(this->socket);
+    if (server < 0 || bind(server, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(server, SOMAXCONN)) {
+        CERR(TRUE, "Couldn't open the socket");
+        if (server >= 0) { close(server); }
+        free(entries);
+        return IO_ERR;
+    }
+
+    for (;;) {
+        conn = accept(server, NULL, NULL);
+        if (conn < 0) {
+            /* A signal, or a client that left before it was accepted */
+            if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) {
+                continue;
+            }
+            break;
+        }
+
+        payload = NULL;
+        ret_code = _receive_request(conn, &payload, &len, fds);
+        if (ret_code == 0) {
+            ret_code = _handle_request(entries, ++tick, payload, len, fds);
+        }
+
+        sprintf(response, "%d\n", ret_code);
+        _write_full(conn, response, strlen(response));
+
+        if (fds[0] >= 0) { close(fds[0]); }
+        if (fds[1] >= 0) { close(fds[1]); }
+        free(payload);
+        close(conn);
+    }
+
+    CERR(TRUE, "Couldn't accept a connection");
+    close(server);
+    unlink(this->socket);
+
+    for (i = 0; i < SERVER_ENTRIES_MAX; ++i) {
+        if (entries[i].key == NULL) { continue; }
+        entries[i].worker.clear(&entries[i].worker);
+        entries[i].base.clear(&entries[i].base);
+        free(entries[i].key);
+    }
+    free(entries);
+    return IO_ERR;
+}
+
+/**
+ * @brief Build the payload of a request: the working directory and the
+ * arguments of the client (without the socket argument)
+ * @param this The preprocessor
+ * @param payload The payload (must be freed)
+ * @param len The length of the payload
+ * @return int The return code
+ */
+int _build_payload(CPreprocessor *const this, string *payload, size_t *len) {
+    size_t capacity = BUFFER_SIZE;
+    size_t used;
+    string aux_buff;
+    int i;
+
+    *payload = NULL;
+    do {
+        capacity *= 2;
+        aux_buff = realloc(*payload, capacity);
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the request");
+            free(*payload);
+            return MALLOC_ERR;
+        }
+        *payload = aux_buff;
+    } while (getcwd(*payload, capacity) == NULL);
+    used = strlen(*payload) + 1;
+
+    for (i = 1; i < this->_argc; ++i) {
+        size_t arg_len = strlen(this->_argv[i]) + 1;
+
+        if (this->_argv[i][0] == '-' && this->_argv[i][1] == 'C') {
+            /* Skip the socket */
+            if (arg_len == 3) { i++; }
+            continue;
+        }
+
+        if (used + arg_len > capacity) {
+            while (used + arg_len > capacity) { capacity *= 2; }
+            aux_buff = realloc(*payload, capacity);
+            if (aux_buff == NULL) {
+                CERR(TRUE, "Couldn't allocate memory for the request");
+                free(*payload);
+                return MALLOC_ERR;
+            }
+            *payload = aux_buff;
+        }
+
+        memcpy(*payload + used, this->_argv[i], arg_len);
+        used += arg_len;
+    }
+
+    *len = used;
+    return 0;
+}
+
+int server_forward(CPreprocessor *const this, int *sent) {
+    struct sockaddr_un addr;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    ServerControl control;
+    char header[SERVER_HEADER_SIZE + 1];
+    string payload;
+    size_t len, used = 0;
+    int fds[2] = {0, 1};
+    int conn;
+    int ret_code;
+
+    *sent = FALSE;
+    ret_code = _socket_address(this->socket, &addr);
+    if (ret_code != 0) { return ret_code; }
+
+    conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn < 0 || connect(conn, (struct sockaddr *)&addr, sizeof(addr))) {
+        /* No server, so the caller runs the command line itself */
+        DEBUG_MSG("Couldn't connect to the server");
+        if (conn >= 0) { close(conn); }
+        return 0;
+    }
+    *sent = TRUE;
+
+    ret_code = _build_payload(this, &payload, &len);
+    if (ret_code != 0) {
+        close(conn);
+        return ret_code;
+    }
+
+    /* The header carries the standard input/output */
+    sprintf(header, "%lu\n", (unsigned long)len);
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base = header;
+    iov.iov_len = strlen(header);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data;
+    msg.msg_controllen = sizeof(control.data);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 2 * sizeof(int));
+
+    ret_code = sendmsg(conn, &msg, 0) == (ssize_t)iov.iov_len ? 0 : IO_ERR;
+    if (ret_code == 0) { ret_code = _write_full(conn, payload, len); }
+    free(payload);
+
+    /* Wait for the return code of the request */
+    while (ret_code == 0 && used < SERVER_HEADER_SIZE &&
+           memchr(header, '\n', used) == NULL) {
+        ssize_t received = read(conn, header + used, SERVER_HEADER_SIZE - used);
+
+        if (received <= 0) {
+            ret_code = IO_ERR;
+        } else {
+            used += received;
+        }
+    }
+
+    close(conn);
+    if (ret_code != 0) { return ret_code; }
+
+    header[used] = '\0';
+    return (int)strtol(header, NULL, 10);
+}
+
+#else
+
+int server_run(CPreprocessor *const this) {
+    (void)this;
+    DEBUG_MSG("The server mode is not supported on this platform");
+    return IO_ERR;
+}
+
+int server_forward(CPreprocessor *const this, int *sent) {
+    (void)this;
+    *sent = FALSE;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * @file server.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the server (daemon) mode
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "cpreprocessor.h"
+
+#define SERVER_ENTRIES_MAX 16          /* The command lines that are kept */
+#define SERVER_REQUEST_MAX (1L << 20) /* The maximum size of a request */
+#define SERVER_HEADER_SIZE 32         /* The maximum size of the header */
+
+/**
+ * @brief A command line state kept by the server. The base preprocessor holds
+ * the macros and the include directories of the command line, while the worker
+ * keeps the caches (the read headers, the resolved include paths, the atoms)
+ * between the requests.
+ */
+typedef struct ServerEntry {
+    string key; /* The directory and the state arguments (NULL if unused) */
+    unsigned long used; /* When the entry was last used */
+    CPreprocessor base;
+    CPreprocessor worker;
+} ServerEntry;
+
+/**
+ * @brief Run as a server: listen on the socket of the preprocessor, and
+ * preprocess the requests sent by the clients (one at a time). The requests
+ * that use the same working directory and the same -D/-I arguments share the
+ * same warm state. The cached headers, include paths and snapshots are
+ * checked (by the modification time and inode of the files and directories)
+ * before every request.
+ * @param this The preprocessor
+ * @return int The return code (the server only stops on errors)
+ */
+int server_run(CPreprocessor *const this);
+
+/**
+ * @brief Run as a client: send the command line, the working directory and
+ * the standard input/output to the server, and wait for the result. If the
+ * server is not running, nothing is sent, and the caller must run the command
+ * line itself.
+ * @param this The preprocessor
+ * @param sent The request was sent (FALSE if there is no server)
+ * @return int The return code of the request
+ */
+int server_forward(CPreprocessor *const this, int *sent);
+
+#endif
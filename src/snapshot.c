@@ -0,0 +1,279 @@
+/**
+ * @file snapshot.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the macros snapshots
+ * @copyright Copyright (c) 2021
+ */
+
+#include "snapshot.h"
+
+/**
+ * @brief Get the slots of the snapshot
+ * @param this The snapshot
+ * @return const SnapshotSlot* The slots (they follow the header)
+ */
+const SnapshotSlot *_snapshot_slots(Snapshot *const this) {
+    return (const SnapshotSlot *)(this->_data + sizeof(SnapshotHeader));
+}
+
+int snapshot_save(Hashmap *const macros, string path) {
+    SnapshotHeader header;
+    SnapshotSlot *slots;
+    const StringsPair *pair;
+    string tmp_path;
+    unsigned long offset, id;
+    int pos = 0;
+    int hash_id;
+    int ret_code = 0;
+    FILE *file;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    header.word_size = sizeof(unsigned long);
+    hash_config(&hash_id, &header.hash_seed);
+    header.hash_id = hash_id;
+    while (macros->next(macros, &pos, &pair) == 0) { header.size++; }
+
+    /* At most half of the slots are used */
+    header.capacity = SNAPSHOT_SIZE_START;
+    while (header.capacity < 2 * header.size) { header.capacity *= 2; }
+
+    slots = calloc(header.capacity, sizeof(SnapshotSlot));
+    if (slots == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the snapshot");
+        return MALLOC_ERR;
+    }
+
+    /* Place the macros, computing the offsets of their strings */
+    offset = sizeof(SnapshotHeader) + header.capacity * sizeof(SnapshotSlot);
+    pos = 0;
+    while (macros->next(macros, &pos, &pair) == 0) {
+        unsigned long h = hash(pair->first);
+
+        id = hash_slot(h, header.capacity);
+        while (slots[id].key != 0) { id = (id + 1) & (header.capacity - 1); }
+
+        slots[id].hash = h;
+        slots[id].key = offset;
+        offset += strlen(pair->first) + 1;
+        slots[id].value = offset;
+        offset += strlen(pair->second) + 1;
+    }
+    header.file_size = offset;
+
+    /* The file is replaced only once it is complete */
+    tmp_path = calloc(strlen(path) + 5, 1);
+    if (tmp_path == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the snapshot");
+        free(slots);
+        return MALLOC_ERR;
+    }
+    strcpy(tmp_path, path);
+    strcat(tmp_path, ".tmp");
+
+    file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        CERR(TRUE, "Couldn't open the snapshot file");
+        free(tmp_path);
+        free(slots);
+        return FILE_ERR;
+    }
+
+    /* The strings are written in the same order they were placed */
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(slots, sizeof(SnapshotSlot), header.capacity, file) !=
+            header.capacity) {
+        ret_code = IO_ERR;
+    }
+
+    pos = 0;
+    while (ret_code == 0 && macros->next(macros, &pos, &pair) == 0) {
+        if (fwrite(pair->first, strlen(pair->first) + 1, 1, file) != 1 ||
+            fwrite(pair->second, strlen(pair->second) + 1, 1, file) != 1) {
+            ret_code = IO_ERR;
+        }
+    }
+
+    if (fclose(file) != 0 && ret_code == 0) { ret_code = IO_ERR; }
+
+    /* Some systems don't rename over an existing file */
+    if (ret_code == 0 && rename(tmp_path, path) != 0 &&
+        (remove(path) != 0 || rename(tmp_path, path) != 0)) {
+        ret_code = IO_ERR;
+    }
+    if (ret_code != 0) { remove(tmp_path); }
+    CERR(ret_code != 0, "Couldn't write the snapshot file");
+
+    free(tmp_path);
+    free(slots);
+    return ret_code;
+}
+
+int snapshot_hash(string path, int *hash_id, unsigned long *seed) {
+    SnapshotHeader header;
+    FILE *file;
+    int ret_code = FILE_ERR;
+
+    file = fopen(path, "rb");
+    if (file == NULL) { return FILE_ERR; }
+
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) == 0 &&
+        header.word_size == sizeof(unsigned long) &&
+        header.hash_id < HASH_FUNCTIONS) {
+        *hash_id = (int)header.hash_id;
+        *seed = header.hash_seed;
+        ret_code = 0;
+    }
+
+    fclose(file);
+    return ret_code;
+}
+
+int snapshot_load(Snapshot *const this, string path) {
+    const SnapshotSlot *slots;
+    size_t size;
+    unsigned long i, seed;
+    FILE *file;
+    int hash_id;
+    int ret_code;
+
+    this->_path = calloc(strlen(path) + 1, 1);
+    if (this->_path == NULL) {
+        CERR(TRUE, "Couldn't allocate memory for the snapshot");
+        return MALLOC_ERR;
+    }
+    strcpy(this->_path, path);
+
+    /* The stamp is taken first, so a change while loading is seen later */
+    stamp_path(path, &this->_stamp);
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        CERR(TRUE, "Couldn't open the snapshot file");
+        this->clear(this);
+        return FILE_ERR;
+    }
+
+    ret_code = this->_file.open(&this->_file, file);
+    fclose(file);
+    if (ret_code != 0) {
+        this->clear(this);
+        return ret_code;
+    }
+
+    this->_file.contents(&this->_file, &this->_data, &size);
+    this->_header = (const SnapshotHeader *)this->_data;
+
+    /* Check the file, so the lookups don't need to */
+    ret_code = FILE_ERR;
+    if (size >= sizeof(SnapshotHeader) &&
+        memcmp(this->_header->magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) ==
+            0 &&
+        this->_header->word_size == sizeof(unsigned long) &&
+        this->_header->hash_id < HASH_FUNCTIONS &&
+        this->_header->file_size == size && this->_data[size - 1] == '\0' &&
+        this->_header->capacity != 0 &&
+        (this->_header->capacity & (this->_header->capacity - 1)) == 0 &&
+        this->_header->size < this->_header->capacity &&
+        this->_header->capacity <=
+            (size - sizeof(SnapshotHeader)) / sizeof(SnapshotSlot)) {
+        ret_code = 0;
+        slots = _snapshot_slots(this);
+
+        for (i = 0; i < this->_header->capacity && ret_code == 0; ++i) {
+            if (slots[i].key != 0 &&
+                (slots[i].key >= size || slots[i].value >= size)) {
+                ret_code = FILE_ERR;
+            }
+        }
+    }
+
+    if (ret_code != 0) {
+        DEBUG_MSG("Invalid snapshot file");
+        this->clear(this);
+        return ret_code;
+    }
+
+    hash_config(&hash_id, &seed);
+    this->_rehash = this->_header->hash_id != (unsigned long)hash_id ||
+                    this->_header->hash_seed != seed;
+    return 0;
+}
+
+int snapshot_find(Snapshot *const this, string key, unsigned long hash,
+                  string *value) {
+    const SnapshotSlot *slots;
+    unsigned long mask, id;
+
+    if (this->_header == NULL) { return 1; }
+
+    if (this->_rehash) {
+        hash = hash_span_with((int)this->_header->hash_id,
+                              this->_header->hash_seed, key, strlen(key));
+    }
+
+    slots = _snapshot_slots(this);
+    mask = this->_header->capacity - 1;
+    id = hash_slot(hash, this->_header->capacity);
+
+    while (slots[id].key != 0) {
+        if (slots[id].hash == hash &&
+            strcmp(this->_data + slots[id].key, key) == 0) {
+            *value = (string)(this->_data + slots[id].value);
+            return 0;
+        }
+        id = (id + 1) & mask;
+    }
+
+    return 1;
+}
+
+int snapshot_next(Snapshot *const this, unsigned long *pos, string *key,
+                  string *value) {
+    const SnapshotSlot *slots;
+
+    if (this->_header == NULL) { return 1; }
+
+    slots = _snapshot_slots(this);
+    while (*pos < this->_header->capacity) {
+        const SnapshotSlot *slot = &slots[(*pos)++];
+
+        if (slot->key != 0) {
+            *key = (string)(this->_data + slot->key);
+            *value = (string)(this->_data + slot->value);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int snapshot_revalidate(Snapshot *const this) {
+    FileStamp stamp;
+    string path;
+    int ret_code;
+
+    if (this->_path == NULL) { return FILE_ERR; }
+
+    stamp_path(this->_path, &stamp);
+    if (stamp_equal(&stamp, &this->_stamp)) { return 0; }
+
+    /* The path is kept, as the clear releases it */
+    path = this->_path;
+    this->_path = NULL;
+    this->clear(this);
+
+    ret_code = this->load(this, path);
+    free(path);
+    return ret_code != 0 ? ret_code : 1;
+}
+
+int snapshot_clear(Snapshot *const this) {
+    this->_file.close(&this->_file);
+    free(this->_path);
+    this->_path = NULL;
+    this->_data = NULL;
+    this->_header = NULL;
+    this->_rehash = FALSE;
+    return 0;
+}
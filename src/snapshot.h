@@ -0,0 +1,142 @@
+/**
+ * @file snapshot.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the macros snapshots
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "hashmap.h"
+#include "reader.h"
+#include "stamp.h"
+
+#define SNAPSHOT_MAGIC "CPPSNAP2" /* The first bytes of a snapshot file */
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_SIZE_START 16 /* Minimum number of slots */
+
+/* A "constructor" for the snapshot */
+#define INIT_SNAPSHOT                                                     \
+    {                                                                     \
+        INIT_READER, 0, 0, 0, 0, {0, 0, 0, 0, 0, 0}, snapshot_load,       \
+            snapshot_find, snapshot_next, snapshot_revalidate,            \
+            snapshot_clear                                                \
+    }
+
+/**
+ * @brief The start of a snapshot file. All the positions in the file are
+ * offsets from its start, so the file can be used wherever it is mapped.
+ */
+typedef struct SnapshotHeader {
+    char magic[SNAPSHOT_MAGIC_SIZE];
+    unsigned long word_size; /* sizeof(unsigned long) of the writer */
+    unsigned long hash_id;   /* The hashing function of the stored hashes */
+    unsigned long hash_seed; /* And its seed */
+    unsigned long capacity;  /* The number of slots (a power of two) */
+    unsigned long size;      /* The number of macros */
+    unsigned long file_size;
+} SnapshotHeader;
+
+/**
+ * @brief A slot of the snapshot table (linear probing). The strings are stored
+ * after the slots, null-terminated.
+ */
+typedef struct SnapshotSlot {
+    unsigned long hash;  /* Computed with the function of the header */
+    unsigned long key;   /* The offset of the name (0 for an empty slot) */
+    unsigned long value; /* The offset of the value */
+} SnapshotSlot;
+
+/**
+ * @brief A loaded snapshot of the macros. The file is mapped (when possible)
+ * and the lookups are done directly on it. The run adopts the hashing function
+ * and the seed of the snapshot, unless others were requested explicitly; only
+ * then are the searched keys hashed again, with the ones of the snapshot.
+ */
+typedef struct Snapshot {
+    InputReader _file;
+    const char *_data;
+    const SnapshotHeader *_header;
+    int _rehash; /* The snapshot uses other hashes than the current ones */
+    string _path;     /* The path it was loaded from */
+    FileStamp _stamp; /* The version of the file that was loaded */
+
+    int (*load)(struct Snapshot *const this, string path);
+    int (*find)(struct Snapshot *const this, string key, unsigned long hash,
+                string *value);
+    int (*next)(struct Snapshot *const this, unsigned long *pos, string *key,
+                string *value);
+    int (*revalidate)(struct Snapshot *const this);
+    int (*clear)(struct Snapshot *const this);
+} Snapshot;
+
+/**
+ * @brief Write the macros into a snapshot file. The file is written under a
+ * temporary name, in the same directory, and then renamed, so the processes
+ * that have the old file mapped keep reading it, whole.
+ * @param macros The macros
+ * @param path The path of the file
+ * @return int The return code
+ */
+int snapshot_save(Hashmap *const macros, string path);
+
+/**
+ * @brief Read the hashing function and the seed a snapshot file was saved
+ * with (only its header is read, so it can be done before anything is hashed)
+ * @param path The path of the file
+ * @param hash_id The id of the function (one of the HASH_* values)
+ * @param seed The seed
+ * @return int The return code (0 for no errors, FILE_ERR for missing or
+ * invalid files)
+ */
+int snapshot_hash(string path, int *hash_id, unsigned long *seed);
+
+/**
+ * @brief Load a snapshot file, and check that it is valid
+ * @param this The snapshot this function is attached to
+ * @param path The path of the file
+ * @return int The return code (0 for no errors, FILE_ERR for missing or
+ * invalid files)
+ */
+int snapshot_load(Snapshot *const this, string path);
+
+/**
+ * @brief Search a macro in the snapshot
+ * @param this The snapshot this function is attached to
+ * @param key The name of the macro
+ * @param hash The hash of the name (computed with hash_span)
+ * @param value The value of the macro (it must not be modified)
+ * @return int The return code (0 if found, 1 if not)
+ */
+int snapshot_find(Snapshot *const this, string key, unsigned long hash,
+                  string *value);
+
+/**
+ * @brief Iterate over the macros of the snapshot
+ * @param this The snapshot this function is attached to
+ * @param pos The position of the iteration (must start from 0)
+ * @param key The name of the next macro
+ * @param value The value of the next macro
+ * @return int The return code (0 for a macro, 1 at the end)
+ */
+int snapshot_next(Snapshot *const this, unsigned long *pos, string *key,
+                  string *value);
+
+/**
+ * @brief Load the snapshot again, if its file was modified or replaced since
+ * it was loaded (checked by the modification time and inode of the file)
+ * @param this The snapshot this function is attached to
+ * @return int The return code (0 if the file is the same, 1 if it was loaded
+ * again, FILE_ERR if it can't be loaded anymore)
+ */
+int snapshot_revalidate(Snapshot *const this);
+
+/**
+ * @brief Release the snapshot
+ * @param this The snapshot this function is attached to
+ * @return int The return code
+ */
+int snapshot_clear(Snapshot *const this);
+
+#endif
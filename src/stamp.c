@@ -0,0 +1,53 @@
+/**
+ * @file stamp.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the file stamps
+ * @copyright Copyright (c) 2021
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define STAMP_USE_STAT
+#endif
+
+#include "stamp.h"
+
+#include <string.h>
+
+#ifdef STAMP_USE_STAT
+#include <sys/stat.h>
+#endif
+
+int stamp_path(const char *path, FileStamp *stamp) {
+#ifdef STAMP_USE_STAT
+    struct stat st;
+#endif
+
+    memset(stamp, 0, sizeof(FileStamp));
+
+#ifdef STAMP_USE_STAT
+    if (stat(path, &st) != 0) { return 1; }
+
+    stamp->dev = (unsigned long)st.st_dev;
+    stamp->ino = (unsigned long)st.st_ino;
+    stamp->mtime = (long)st.st_mtime;
+#ifdef __APPLE__
+    stamp->mtime_nsec = (long)st.st_mtimespec.tv_nsec;
+#else
+    stamp->mtime_nsec = (long)st.st_mtim.tv_nsec;
+#endif
+    stamp->size = (long)st.st_size;
+    stamp->exists = TRUE;
+    return 0;
+#else
+    (void)path;
+    return 1;
+#endif
+}
+
+int stamp_equal(const FileStamp *first, const FileStamp *second) {
+    return first->exists == second->exists && first->dev == second->dev &&
+           first->ino == second->ino && first->mtime == second->mtime &&
+           first->mtime_nsec == second->mtime_nsec &&
+           first->size == second->size;
+}
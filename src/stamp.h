@@ -0,0 +1,43 @@
+/**
+ * @file stamp.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the file stamps
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef STAMP_H
+#define STAMP_H
+
+#include "error_handling.h"
+
+/**
+ * @brief The identity and the version of a file (or directory). If any of the
+ * fields changes, the file was replaced or modified.
+ */
+typedef struct FileStamp {
+    unsigned long dev;
+    unsigned long ino;
+    long mtime;
+    long mtime_nsec;
+    long size;
+    int exists;
+} FileStamp;
+
+/**
+ * @brief Get the stamp of a file. If the file doesn't exist (or the stamps are
+ * not supported), the stamp is marked as not existing
+ * @param path The path of the file
+ * @param stamp The stamp
+ * @return int The return code (0 if the file exists, 1 otherwise)
+ */
+int stamp_path(const char *path, FileStamp *stamp);
+
+/**
+ * @brief Compare two stamps
+ * @param first The first stamp
+ * @param second The second stamp
+ * @return int TRUE if they are the same, FALSE otherwise
+ */
+int stamp_equal(const FileStamp *first, const FileStamp *second);
+
+#endif
@@ -0,0 +1,227 @@
+/**
+ * @file stats.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the run statistics
+ * @copyright Copyright (c) 2021
+ */
+
+#include "stats.h"
+
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STATS_USE_RDTSC
+#endif
+
+Stats stats;
+
+/* The names of the phases, in the order of their ids */
+const char *const _phase_names[STATS_PHASES] = {
+    "read", "scan", "expand", "lookup", "insert", "resize", "write", "skip"};
+
+/* The probe lengths of the histogram buckets */
+const char *const _bucket_names[STATS_HISTOGRAM] = {
+    "1", "2", "3", "4", "5-8", "9-16", "17-32", "33+"};
+
+/**
+ * @brief Read the cycles counter
+ * @return double The number of cycles (or of clock ticks)
+ */
+double _stats_clock(void) {
+#ifdef STATS_USE_RDTSC
+    return (double)__builtin_ia32_rdtsc();
+#else
+    return (double)clock();
+#endif
+}
+
+void stats_enable(int json) {
+    memset(&stats, 0, sizeof(Stats));
+    stats.json = json;
+    stats.enabled = TRUE;
+    stats._start = _stats_clock();
+}
+
+void stats_begin(int phase) {
+    StatsPhase *p = &stats.phases[phase];
+
+    p->calls++;
+    if (p->_depth++ == 0) { p->_start = _stats_clock(); }
+}
+
+void stats_end(int phase, size_t bytes) {
+    StatsPhase *p = &stats.phases[phase];
+
+    p->bytes += (double)bytes;
+    if (--p->_depth == 0) { p->cycles += _stats_clock() - p->_start; }
+}
+
+void stats_probe(unsigned long len) {
+    stats.probes += (double)len;
+    if (len > stats.probe_max) { stats.probe_max = len; }
+}
+
+/**
+ * @brief Get the histogram bucket of a probe length
+ * @param len The probe length (at least 1)
+ * @return int The bucket
+ */
+int _histogram_bucket(unsigned int len) {
+    int bucket = 0;
+
+    if (len <= 4) { return len - 1; }
+
+    /* Powers of two, starting with 5-8 */
+    len = (len - 1) >> 2;
+    while (len != 0 && bucket < STATS_HISTOGRAM - 4) {
+        len >>= 1;
+        bucket++;
+    }
+    return bucket + 3;
+}
+
+void stats_table(StatsTable *table, const char *name, const Hashmap *map) {
+    double total = 0;
+    int cluster = 0;
+    int used = 0;
+    int i;
+
+    memset(table, 0, sizeof(StatsTable));
+    table->name = name;
+    table->size = map->_size;
+    table->capacity = map->_capacity;
+
+    for (i = 0; i < map->_capacity; ++i) {
+        if (map->slots[i]._dist != 0) {
+            used++;
+            total += map->slots[i]._dist;
+            if (map->slots[i]._dist > table->probe_max) {
+                table->probe_max = map->slots[i]._dist;
+            }
+            table->histogram[_histogram_bucket(map->slots[i]._dist)]++;
+
+            /* The runs that wrap around the end are split in two */
+            if (++cluster > table->cluster_max) {
+                table->cluster_max = cluster;
+            }
+        } else {
+            cluster = 0;
+        }
+    }
+
+    /* The entries that were not moved yet by a resize are not counted */
+    table->probe_avg = used != 0 ? total / used : 0;
+}
+
+/**
+ * @brief Print the statistics as a table
+ * @param tables The usage of the hashmaps
+ * @param count The number of hashmaps
+ * @param total The cycles of the whole run
+ */
+void _print_table(const StatsTable *tables, int count, double total) {
+    const StatsPhase *p;
+    unsigned long lookups = stats.phases[STATS_LOOKUP].calls;
+    unsigned long seed;
+    int hash_id;
+    int i, j;
+
+    fprintf(stderr, "%-8s %12s %14s %16s %7s\n", "phase", "calls", "bytes",
+            "cycles", "share");
+    for (i = 0; i < STATS_PHASES; ++i) {
+        p = &stats.phases[i];
+        fprintf(stderr, "%-8s %12lu %14.0f %16.0f %6.1f%%\n", _phase_names[i],
+                p->calls, p->bytes, p->cycles, p->cycles * 100 / total);
+    }
+    fprintf(stderr, "%-8s %12s %14s %16.0f\n", "total", "", "", total);
+
+    fprintf(stderr, "\nprobes: %.2f average, %lu max (%lu lookups)\n\n",
+            lookups != 0 ? stats.probes / lookups : 0, stats.probe_max,
+            lookups);
+
+    hash_config(&hash_id, &seed);
+    fprintf(stderr, "hash: %s (seed %lu)\n", hash_name(hash_id), seed);
+    fprintf(stderr, "%-12s %10s %10s %7s %10s %10s %10s\n", "hashmap", "size",
+            "capacity", "load", "probe avg", "probe max", "run max");
+    for (i = 0; i < count; ++i) {
+        fprintf(stderr, "%-12s %10d %10d %6.1f%% %10.2f %10u %10d\n",
+                tables[i].name, tables[i].size, tables[i].capacity,
+                tables[i].capacity != 0
+                    ? tables[i].size * 100.0 / tables[i].capacity
+                    : 0,
+                tables[i].probe_avg, tables[i].probe_max,
+                tables[i].cluster_max);
+    }
+
+    /* The number of keys found after 1, 2, 3, 4, 5-8, ... probes */
+    fprintf(stderr, "\n%-12s", "probes");
+    for (j = 0; j < STATS_HISTOGRAM; ++j) {
+        fprintf(stderr, " %8s", _bucket_names[j]);
+    }
+    fprintf(stderr, "\n");
+    for (i = 0; i < count; ++i) {
+        fprintf(stderr, "%-12s", tables[i].name);
+        for (j = 0; j < STATS_HISTOGRAM; ++j) {
+            fprintf(stderr, " %8lu", tables[i].histogram[j]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+/**
+ * @brief Print the statistics as a JSON object
+ * @param tables The usage of the hashmaps
+ * @param count The number of hashmaps
+ * @param total The cycles of the whole run
+ */
+void _print_json(const StatsTable *tables, int count, double total) {
+    const StatsPhase *p;
+    unsigned long seed;
+    int hash_id;
+    int i, j;
+
+    hash_config(&hash_id, &seed);
+    fprintf(stderr, "{\"cycles\": %.0f, \"hash\": {\"function\": \"%s\", "
+            "\"seed\": %lu}, \"phases\": {", total, hash_name(hash_id), seed);
+    for (i = 0; i < STATS_PHASES; ++i) {
+        p = &stats.phases[i];
+        fprintf(stderr,
+                "%s\"%s\": {\"calls\": %lu, \"bytes\": %.0f, \"cycles\": "
+                "%.0f}",
+                i != 0 ? ", " : "", _phase_names[i], p->calls, p->bytes,
+                p->cycles);
+    }
+
+    fprintf(stderr,
+            "}, \"probes\": {\"total\": %.0f, \"max\": %lu}, \"hashmaps\": {",
+            stats.probes, stats.probe_max);
+    for (i = 0; i < count; ++i) {
+        fprintf(stderr,
+                "%s\"%s\": {\"size\": %d, \"capacity\": %d, \"probe_avg\": "
+                "%.3f, \"probe_max\": %u, \"run_max\": %d, \"histogram\": [",
+                i != 0 ? ", " : "", tables[i].name, tables[i].size,
+                tables[i].capacity, tables[i].probe_avg, tables[i].probe_max,
+                tables[i].cluster_max);
+        for (j = 0; j < STATS_HISTOGRAM; ++j) {
+            fprintf(stderr, "%s%lu", j != 0 ? ", " : "",
+                    tables[i].histogram[j]);
+        }
+        fprintf(stderr, "]}");
+    }
+    fprintf(stderr, "}}\n");
+}
+
+int stats_print(const StatsTable *tables, int count) {
+    double total = _stats_clock() - stats._start;
+
+    if (!stats.enabled) { return 0; }
+    if (total <= 0) { total = 1; }
+
+    if (stats.json) {
+        _print_json(tables, count, total);
+    } else {
+        _print_table(tables, count, total);
+    }
+
+    return ferror(stderr) ? IO_ERR : 0;
+}
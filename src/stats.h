@@ -0,0 +1,140 @@
+/**
+ * @file stats.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the run statistics (--stats)
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "hashmap.h"
+
+/* Enable/Disable the instrumentation (compile with -DNO_STATS to remove it) */
+#ifdef NO_STATS
+#define STATS_MODE 0
+#else
+#define STATS_MODE 1
+#endif
+
+#define STATS_TABLES_MAX 8 /* The maximum number of reported hashmaps */
+#define STATS_HISTOGRAM 8  /* Probe lengths 1, 2, 3, 4, 5-8, 9-16, 17-32, 33+ */
+
+/* The instrumented phases of a run */
+#define STATS_READ 0    /* Reading the input lines */
+#define STATS_SCAN 1    /* Splitting the lines into words */
+#define STATS_EXPAND 2  /* Expanding the macros (the recursion is included) */
+#define STATS_LOOKUP 3  /* Searching the hashmaps */
+#define STATS_INSERT 4  /* Inserting into the hashmaps (resizes included) */
+#define STATS_RESIZE 5  /* Resizing the hashmaps */
+#define STATS_WRITE 6   /* Writing the output */
+#define STATS_SKIP 7    /* Skipping the inactive regions */
+#define STATS_PHASES 8
+
+#if STATS_MODE
+/* Start measuring a phase */
+#define STATS_BEGIN(phase)                          \
+    do {                                            \
+        if (stats.enabled) { stats_begin(phase); } \
+    } while (0)
+
+/* Stop measuring a phase, that processed a number of bytes */
+#define STATS_END(phase, bytes)                          \
+    do {                                                 \
+        if (stats.enabled) { stats_end(phase, bytes); } \
+    } while (0)
+
+/* Record the length of a hashmap probe sequence */
+#define STATS_PROBE(len)                          \
+    do {                                          \
+        if (stats.enabled) { stats_probe(len); } \
+    } while (0)
+#else
+#define STATS_BEGIN(phase)
+#define STATS_END(phase, bytes)
+#define STATS_PROBE(len)
+#endif
+
+/**
+ * @brief The counters of a phase. The cycles are read from the time-stamp
+ * counter where it is available (x86), or from the process clock otherwise.
+ */
+typedef struct StatsPhase {
+    unsigned long calls;
+    double bytes;
+    double cycles;
+    double _start;
+    int _depth; /* Nested (recursive) calls are measured only once */
+} StatsPhase;
+
+/**
+ * @brief The usage of a hashmap, at the end of a run. It shows how well the
+ * hashing function spreads the keys.
+ */
+typedef struct StatsTable {
+    const char *name;
+    int size;
+    int capacity;
+    double probe_avg; /* The average probe length of the stored keys */
+    unsigned int probe_max;
+    int cluster_max; /* The longest run of used slots */
+    unsigned long histogram[STATS_HISTOGRAM]; /* The keys, by probe length */
+} StatsTable;
+
+/**
+ * @brief The statistics of a run. They are global, as the instrumented code
+ * (reader, hashmap, ...) doesn't know about the preprocessor.
+ */
+typedef struct Stats {
+    int enabled;
+    int json; /* Print them as JSON, instead of a table */
+    StatsPhase phases[STATS_PHASES];
+    double probes; /* The total length of the probe sequences */
+    unsigned long probe_max;
+    double _start;
+} Stats;
+
+extern Stats stats;
+
+/**
+ * @brief Reset the counters and start collecting the statistics
+ * @param json If the statistics will be printed as JSON
+ */
+void stats_enable(int json);
+
+/**
+ * @brief Start measuring a phase (use STATS_BEGIN)
+ * @param phase The phase
+ */
+void stats_begin(int phase);
+
+/**
+ * @brief Stop measuring a phase (use STATS_END)
+ * @param phase The phase
+ * @param bytes The bytes processed by the phase
+ */
+void stats_end(int phase, size_t bytes);
+
+/**
+ * @brief Record the length of a hashmap probe sequence (use STATS_PROBE)
+ * @param len The number of visited slots
+ */
+void stats_probe(unsigned long len);
+
+/**
+ * @brief Compute the usage of a hashmap
+ * @param table The result
+ * @param name The name of the hashmap, used in the report
+ * @param map The hashmap
+ */
+void stats_table(StatsTable *table, const char *name, const Hashmap *map);
+
+/**
+ * @brief Print the statistics on stderr (as a table or as JSON)
+ * @param tables The usage of the hashmaps
+ * @param count The number of hashmaps
+ * @return int The return code (0 for no errors)
+ */
+int stats_print(const StatsTable *tables, int count);
+
+#endif
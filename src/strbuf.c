@@ -0,0 +1,50 @@
+/**
+ * @file strbuf.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the string builder
+ * @copyright Copyright (c) 2021
+ */
+
+#include "strbuf.h"
+
+int strbuf_append(StringBuilder *const this, const char *str) {
+    return strbuf_append_span(this, str, strlen(str));
+}
+
+int strbuf_append_span(StringBuilder *const this, const char *str,
+                       size_t len) {
+    if (this->len + len + 1 > this->_capacity) {
+        size_t new_capacity =
+            this->_capacity == 0 ? STRBUF_MIN_CAPACITY : this->_capacity;
+        string aux_buff;
+
+        while (this->len + len + 1 > new_capacity) { new_capacity *= 2; }
+
+        aux_buff = realloc(this->data, new_capacity);
+        if (aux_buff == NULL) {
+            CERR(TRUE, "Couldn't allocate memory for the string");
+            return MALLOC_ERR;
+        }
+        this->data = aux_buff;
+        this->_capacity = new_capacity;
+    }
+
+    memcpy(this->data + this->len, str, len);
+    this->len += len;
+    this->data[this->len] = '\0';
+    return 0;
+}
+
+int strbuf_reset(StringBuilder *const this) {
+    this->len = 0;
+    if (this->data != NULL) { this->data[0] = '\0'; }
+    return 0;
+}
+
+int strbuf_clear(StringBuilder *const this) {
+    free(this->data);
+    this->data = NULL;
+    this->len = 0;
+    this->_capacity = 0;
+    return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file strbuf.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the string builder
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef STRBUF_H
+#define STRBUF_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error_handling.h"
+
+#define STRBUF_MIN_CAPACITY 256 /* The first capacity of a builder */
+
+/* A "constructor" for the string builder */
+#define INIT_STRBUF                                                        \
+    {                                                                      \
+        0, 0, 0, strbuf_append, strbuf_append_span, strbuf_reset,          \
+            strbuf_clear                                                   \
+    }
+
+/**
+ * @brief A growable string. The capacity is doubled when it is exceeded, so
+ * building a string of N characters copies O(N) characters. The data is
+ * always terminated (once something was appended), and it can be moved by the
+ * appends, so the pieces of the string are kept as offsets.
+ */
+typedef struct StringBuilder {
+    string data;
+    size_t len;
+    size_t _capacity;
+
+    int (*append)(struct StringBuilder *const this, const char *str);
+    int (*append_span)(struct StringBuilder *const this, const char *str,
+                       size_t len);
+    int (*reset)(struct StringBuilder *const this);
+    int (*clear)(struct StringBuilder *const this);
+} StringBuilder;
+
+/**
+ * @brief Append a string at the end of the builder
+ * @param this The builder this function is attached to
+ * @param str The string
+ * @return int The return code (0 for no errors)
+ */
+int strbuf_append(StringBuilder *const this, const char *str);
+
+/**
+ * @brief Append the first characters of a string at the end of the builder
+ * @param this The builder this function is attached to
+ * @param str The string (it doesn't have to be terminated)
+ * @param len The number of characters
+ * @return int The return code (0 for no errors)
+ */
+int strbuf_append_span(StringBuilder *const this, const char *str, size_t len);
+
+/**
+ * @brief Empty the builder (the memory is kept, for the next string)
+ * @param this The builder this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int strbuf_reset(StringBuilder *const this);
+
+/**
+ * @brief Free the memory of the builder
+ * @param this The builder this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int strbuf_clear(StringBuilder *const this);
+
+#endif
@@ -0,0 +1,162 @@
+/**
+ * @file writer.c
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The implementation of the output writer
+ * @copyright Copyright (c) 2021
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _XOPEN_SOURCE 600
+#define WRITER_USE_WRITEV
+#endif
+
+#include "writer.h"
+
+#include "stats.h"
+
+#ifdef WRITER_USE_WRITEV
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Write the buffered data, followed by an (optional) span
+ * @param this The writer
+ * @param data The start of the span
+ * @param len The length of the span
+ * @return int The return code
+ */
+int _write_out(OutputWriter *const this, const char *data, size_t len) {
+#ifdef WRITER_USE_WRITEV
+    struct iovec iov[2];
+    int iov_cnt = 0;
+    int first = 0;
+    ssize_t written;
+
+    if (this->_used != 0) {
+        iov[iov_cnt].iov_base = this->_buffer;
+        iov[iov_cnt++].iov_len = this->_used;
+    }
+    if (len != 0) {
+        iov[iov_cnt].iov_base = (void *)data;
+        iov[iov_cnt++].iov_len = len;
+    }
+
+    while (first < iov_cnt) {
+        written = writev(this->_fd, iov + first, iov_cnt - first);
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            CERR(TRUE, "Couldn't write the output");
+            return IO_ERR;
+        }
+
+        /* Skip the parts that were written (the writes can be partial) */
+        while (first < iov_cnt && (size_t)written >= iov[first].iov_len) {
+            written -= iov[first].iov_len;
+            first++;
+        }
+        if (first < iov_cnt) {
+            iov[first].iov_base = (char *)iov[first].iov_base + written;
+            iov[first].iov_len -= written;
+        }
+    }
+#else
+    if (fwrite(this->_buffer, 1, this->_used, this->_output) != this->_used ||
+        fwrite(data, 1, len, this->_output) != len) {
+        CERR(TRUE, "Couldn't write the output");
+        return IO_ERR;
+    }
+#endif
+
+    this->_used = 0;
+    return 0;
+}
+
+int writer_open(OutputWriter *const this, FILE *output) {
+    this->_output = output;
+    this->_used = 0;
+
+    /* Without an output, everything is discarded */
+    if (output == NULL) { return 0; }
+
+    this->_buffer = malloc(WRITER_BUFFER_SIZE);
+
+    if (this->_buffer == NULL) {
+        CERR(TRUE, "Couldn't allocate the output buffer");
+        return MALLOC_ERR;
+    }
+
+#ifdef WRITER_USE_WRITEV
+    /* The data is written directly to the file descriptor, so nothing must be
+     * left in the FILE's own buffer */
+    fflush(output);
+    this->_fd = fileno(output);
+#endif
+    return 0;
+}
+
+/**
+ * @brief Write a span of data (see writer_write)
+ * @param this The writer
+ * @param data The data
+ * @param len The length of the data
+ * @return int The return code (0 for no errors)
+ */
+int _write(OutputWriter *const this, const char *data, size_t len) {
+    int ret_code;
+
+    if (this->_used + len <= WRITER_BUFFER_SIZE) {
+        memcpy(this->_buffer + this->_used, data, len);
+        this->_used += len;
+        return 0;
+    }
+
+    if (len >= WRITER_BUFFER_SIZE / 2) {
+        /* Big spans are not copied */
+        return _write_out(this, data, len);
+    }
+
+    ret_code = _write_out(this, NULL, 0);
+    if (ret_code != 0) { return ret_code; }
+
+    memcpy(this->_buffer, data, len);
+    this->_used = len;
+    return 0;
+}
+
+int writer_write(OutputWriter *const this, const char *data, size_t len) {
+    int ret_code;
+
+    if (this->_output == NULL) { return 0; }
+
+    STATS_BEGIN(STATS_WRITE);
+    ret_code = _write(this, data, len);
+    STATS_END(STATS_WRITE, len);
+
+    return ret_code;
+}
+
+int writer_flush(OutputWriter *const this) {
+    int ret_code;
+
+    if (this->_used == 0) { return 0; }
+
+    ret_code = _write_out(this, NULL, 0);
+    if (ret_code != 0) { return ret_code; }
+
+#ifndef WRITER_USE_WRITEV
+    if (fflush(this->_output) != 0) { return IO_ERR; }
+#endif
+    return 0;
+}
+
+int writer_close(OutputWriter *const this) {
+    int ret_code = 0;
+
+    if (this->_buffer != NULL) { ret_code = this->flush(this); }
+
+    free(this->_buffer);
+    this->_buffer = NULL;
+    this->_used = 0;
+    return ret_code;
+}
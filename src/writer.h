@@ -0,0 +1,76 @@
+/**
+ * @file writer.h
+ * @author Grama Nicolae (gramanicu@gmail.com)
+ * @brief The definitions used for the output writer
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error_handling.h"
+
+#define WRITER_BUFFER_SIZE 65536 /* The size of the output buffer */
+
+/* A "constructor" for the writer */
+#define INIT_WRITER                                                      \
+    {                                                                    \
+        0, -1, 0, 0, writer_open, writer_write, writer_flush, writer_close \
+    }
+
+/**
+ * @brief An output writer. The written spans (pointer + length) are gathered
+ * in a large buffer, which is flushed with a single system call when it is
+ * full. Spans that don't fit in the buffer are written together with it
+ * (vectored write), without being copied.
+ */
+typedef struct OutputWriter {
+    FILE *_output;
+    int _fd;
+    string _buffer;
+    size_t _used;
+
+    int (*open)(struct OutputWriter *const this, FILE *output);
+    int (*write)(struct OutputWriter *const this, const char *data,
+                 size_t len);
+    int (*flush)(struct OutputWriter *const this);
+    int (*close)(struct OutputWriter *const this);
+} OutputWriter;
+
+/**
+ * @brief Prepare the writer for an output file
+ * @param this The writer this function is attached to
+ * @param output The output FILE (NULL to discard the output)
+ * @return int The return code (0 for no errors)
+ */
+int writer_open(OutputWriter *const this, FILE *output);
+
+/**
+ * @brief Write a span of data to the output
+ * @param this The writer this function is attached to
+ * @param data The start of the span
+ * @param len The length of the span
+ * @return int The return code (0 for no errors)
+ */
+int writer_write(OutputWriter *const this, const char *data, size_t len);
+
+/**
+ * @brief Write all the buffered data to the output
+ * @param this The writer this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int writer_flush(OutputWriter *const this);
+
+/**
+ * @brief Flush the buffered data and free the buffer. The output FILE is not
+ * closed.
+ * @param this The writer this function is attached to
+ * @return int The return code (0 for no errors)
+ */
+int writer_close(OutputWriter *const this);
+
+#endif